@@ -0,0 +1,86 @@
+// libkt_alacritty: the Alacritty encoder behind the C plugin ABI of
+// common/kt_plugin.h, built with --crate-type cdylib.
+#![allow(dead_code)]
+
+mod alacritty_mocks;
+use alacritty_mocks::*;
+
+// Include the extracted logic
+include!("alacritty_extracted.rs");
+include!("alacritty_encoder.rs");
+
+use std::ffi::CStr;
+use std::os::raw::{c_char, c_int, c_uint};
+
+const KT_PLUGIN_ABI_VERSION: c_int = 1;
+const KT_ENCODE_ERROR: c_int = -1;
+
+const KT_MOD_SHIFT: c_uint = 0x01;
+const KT_MOD_CTRL: c_uint = 0x02;
+const KT_MOD_ALT: c_uint = 0x04;
+const KT_MOD_SUPER: c_uint = 0x08;
+const KT_MOD_CAPS: c_uint = 0x10;
+const KT_MOD_NUM: c_uint = 0x20;
+
+const KT_ACTION_RELEASE: c_int = 0;
+const KT_ACTION_REPEAT: c_int = 2;
+
+// Mirrors kt_key_event
+#[repr(C)]
+pub struct KtKeyEvent {
+    key: *const c_char,
+    shifted_key: *const c_char,
+    base_key: *const c_char,
+    layout: *const c_char,
+    keycode: c_uint,
+    mods: c_uint,
+    action: c_int,
+    kitty_flags: c_uint,
+    cursor_key_mode: c_int,
+}
+
+#[no_mangle]
+pub extern "C" fn kt_abi_version() -> c_int {
+    KT_PLUGIN_ABI_VERSION
+}
+
+#[no_mangle]
+pub extern "C" fn kt_name() -> *const c_char {
+    b"alacritty\0".as_ptr() as *const c_char
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn kt_encode(ev: *const KtKeyEvent, out: *mut c_char, out_size: usize) -> c_int {
+    if ev.is_null() || out.is_null() {
+        return KT_ENCODE_ERROR;
+    }
+    let ev = &*ev;
+
+    let key_name = if ev.key.is_null() {
+        String::new()
+    } else {
+        CStr::from_ptr(ev.key).to_string_lossy().into_owned()
+    };
+
+    let shifted_key = if ev.shifted_key.is_null() {
+        String::new()
+    } else {
+        CStr::from_ptr(ev.shifted_key).to_string_lossy().into_owned()
+    };
+
+    let mut mods = ModifiersState::empty();
+    if ev.mods & KT_MOD_SHIFT != 0 { mods.insert(ModifiersState::SHIFT); }
+    if ev.mods & KT_MOD_CTRL != 0 { mods.insert(ModifiersState::CONTROL); }
+    if ev.mods & KT_MOD_ALT != 0 { mods.insert(ModifiersState::ALT); }
+    if ev.mods & KT_MOD_SUPER != 0 { mods.insert(ModifiersState::SUPER); }
+
+    let action = if ev.action == KT_ACTION_RELEASE { ElementState::Released } else { ElementState::Pressed };
+    let repeat = ev.action == KT_ACTION_REPEAT;
+
+    let result = encode_key(&key_name, &shifted_key, mods, ev.mods & KT_MOD_CAPS != 0, ev.mods & KT_MOD_NUM != 0,
+                            ev.kitty_flags, action, repeat);
+
+    let len = result.len().min(out_size);
+    std::ptr::copy_nonoverlapping(result.as_ptr(), out as *mut u8, len);
+    len as c_int
+}
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""
+Branch coverage instrumentation shared by the extraction scripts.
+
+instrument() puts a KT_COV_HIT(<id>) (see kt_coverage.h) into every branch
+of extracted upstream code it can recognise line by line:
+
+  - braced blocks opened by if / else if / else / for / while / do,
+    including "} else {" and conditions spanning several lines,
+  - one-line "if (...) statement;" and "else statement;", which are braced,
+  - case and default labels.
+
+Hits are inserted on the line of the branch itself, so line numbers of the
+generated file stay those of the uninstrumented one. Preprocessor lines,
+macro bodies and comments are left alone.
+"""
+import re
+
+HIT = "KT_COV_HIT({})"
+BRANCHES_SUFFIX = ".branches"
+
+BLOCK_START = re.compile(r'^(\}\s*)?(if|else\s+if|else|for|while|do)\b')
+ONE_LINE_ELSE = re.compile(r'^(\}\s*)?else\s+(?!if\b)([^{};]+;)$')
+CASE_LABEL = re.compile(r"^(case\s+('(\\.|[^'\\])'|::|[^:'])+|default)\s*:(?!:)")
+HIT_PATTERN = re.compile(r' ?KT_COV_HIT\((\d+)\);')
+
+def split_comment(line):
+    """Splits a line into code and a trailing // comment, ignoring "//" inside literals."""
+    quote = None
+    i = 0
+    while i < len(line):
+        c = line[i]
+        if quote:
+            if c == '\\':
+                i += 1
+            elif c == quote:
+                quote = None
+        elif c in '"\'':
+            quote = c
+        elif line.startswith('//', i):
+            return line[:i], line[i:]
+        i += 1
+    return line, ""
+
+def condition_end(code, start):
+    """Index just past the parenthesised condition starting at or after `start`, or -1."""
+    i = code.find('(', start)
+    if i < 0:
+        return -1
+    depth = 0
+    quote = None
+    while i < len(code):
+        c = code[i]
+        if quote:
+            if c == '\\':
+                i += 1
+            elif c == quote:
+                quote = None
+        elif c in '"\'':
+            quote = c
+        elif c == '(':
+            depth += 1
+        elif c == ')':
+            depth -= 1
+            if depth == 0:
+                return i + 1
+        i += 1
+    return -1
+
+def instrument(lines):
+    """Returns `lines` (newline-terminated strings) with branch hits inserted."""
+    out = []
+    next_id = 0
+    pending_block = False # Inside a condition that opens a braced block on a later line
+    in_macro = False
+    in_comment = False
+
+    def hit():
+        nonlocal next_id
+        next_id += 1
+        return HIT.format(next_id - 1)
+
+    for line in lines:
+        stripped = line.strip()
+
+        if in_comment:
+            in_comment = '*/' not in stripped
+            out.append(line)
+            continue
+        if in_macro or stripped.startswith('#'):
+            in_macro = line.rstrip('\n').endswith('\\')
+            out.append(line)
+            continue
+        if stripped.startswith('/*'):
+            in_comment = '*/' not in stripped
+            out.append(line)
+            continue
+
+        body = line.rstrip('\n')
+        newline = line[len(body):]
+        code, comment = split_comment(body)
+        code = original = code.rstrip()
+        indent = code[:len(code) - len(code.lstrip())]
+        text = code.lstrip()
+
+        if pending_block:
+            if text.endswith('{'):
+                code = f"{code} {hit()};"
+                pending_block = False
+            elif text.endswith(';') or text.endswith('}'):
+                pending_block = False
+        elif (m := CASE_LABEL.match(text)):
+            code = f"{indent}{text[:m.end()]} {hit()};{text[m.end():]}"
+        elif BLOCK_START.match(text):
+            keyword_end = BLOCK_START.match(text).end()
+            if text.endswith('{'):
+                code = f"{code} {hit()};"
+            elif (m := ONE_LINE_ELSE.match(text)):
+                code = f"{indent}{text[:m.start(2)]}{{ {hit()}; {m.group(2)} }}"
+            elif text.startswith(('if', 'else if', '} else if')) or text.startswith(('for', 'while')):
+                end = condition_end(text, keyword_end)
+                if end < 0:
+                    pending_block = True
+                else:
+                    statement = text[end:].strip()
+                    if statement.startswith('{'):
+                        code = f"{indent}{text[:end]} {{ {hit()};{statement[1:]}"
+                    elif (text.startswith('if') and statement.endswith(';') and
+                            not re.search(r'\belse\b|[{}]', statement)):
+                        code = f"{indent}{text[:end]} {{ {hit()}; {statement} }}"
+                    elif not statement:
+                        # The block's opening brace or statement follows on the next line
+                        pending_block = True
+
+        if code == original:
+            out.append(line)
+        else:
+            out.append(code + (" " + comment if comment else "") + newline)
+    return out
+
+def write_branch_table(inc_path):
+    """Lists "<id>\\t<line>\\t<code>" for every hit in the generated file in <inc>.branches."""
+    branches = []
+    with open(inc_path, encoding='utf-8') as f:
+        for number, line in enumerate(f, 1):
+            code = HIT_PATTERN.sub("", line).strip()
+            for m in HIT_PATTERN.finditer(line):
+                branches.append((int(m.group(1)), number, code))
+    with open(inc_path + BRANCHES_SUFFIX, 'w', encoding='utf-8') as f:
+        for branch_id, number, code in sorted(branches):
+            f.write(f"{branch_id}\t{number}\t{code}\n")
+    return len(branches)
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+t-wise covering arrays for run_tests.py's test plans.
+
+A covering array of strength t over some factors is a list of rows, one
+value per factor, in which every combination of values of every t factors
+appears at least once. With t = 2 (pairwise) every pair of values of any two
+factors is tested together, with t = 3 every triple. The array grows with
+the product of the t largest factors and only logarithmically with their
+number, which is what makes it small next to the full product.
+
+covering_array() builds one with IPOG (Lei et al., "IPOG: A General Strategy
+for T-Way Software Testing", 2007): it starts from the full product of the
+first t factors, then adds one factor at a time, first choosing its value in
+every existing row to cover the most uncovered interactions (horizontal
+growth), then adding rows for the interactions still missing (vertical
+growth). The result is deterministic.
+
+IPOG does poorly when one factor dominates, like the keys of the matrix
+next to the binary modifiers, locks and flag bits: the value of every key
+needs its own rows. For that case there is a direct construction, every
+value of the dominant factor crossed with a (t-1)-wise array of the others,
+plus a t-wise array of the others for the interactions without it.
+"""
+import itertools
+
+# IPOG is quadratic in the number of interactions; larger problems with a
+# dominant factor only use the direct construction
+IPOG_MAX_INTERACTIONS = 100000
+
+def covering_array(levels, strength):
+    """Rows of value indices covering every `strength`-way interaction of factors with `levels` values.
+
+    Factors come out in the given order. Listing the largest ones first
+    gives the smallest arrays. The smaller of the IPOG array and, with a
+    dominant first factor, the direct construction is returned.
+    """
+    strength = min(strength, len(levels))
+    dominant = 1 < strength < len(levels) and levels[0] > max(levels[1:])
+    arrays = []
+    if dominant:
+        arrays.append(split_dominant(levels, strength))
+    if not dominant or count_interactions(levels, strength) <= IPOG_MAX_INTERACTIONS:
+        arrays.append(ipog(levels, strength))
+    return min(arrays, key=len)
+
+def split_dominant(levels, strength):
+    # Interactions with the first factor are each of its values with t-1
+    # values of the others; the rest are t values of the others
+    lower = covering_array(levels[1:], strength - 1)
+    upper = covering_array(levels[1:], strength)
+    rows = [[value] + row for value in range(levels[0]) for row in lower]
+    rows += [[i % levels[0]] + row for i, row in enumerate(upper)]
+    return rows
+
+def count_interactions(levels, strength):
+    total = 0
+    for columns in itertools.combinations(range(len(levels)), strength):
+        count = 1
+        for c in columns:
+            count *= levels[c]
+        total += count
+    return total
+
+def ipog(levels, strength):
+    rows = [list(row) for row in itertools.product(*(range(n) for n in levels[:strength]))]
+    free_rows = [] # Rows with positions no interaction needed yet
+
+    for factor in range(strength, len(levels)):
+        # Interactions with the new factor: (earlier factors, their values, new value)
+        uncovered = set()
+        column_sets = list(itertools.combinations(range(factor), strength - 1))
+        for columns in column_sets:
+            for values in itertools.product(*(range(levels[c]) for c in columns)):
+                for value in range(levels[factor]):
+                    uncovered.add((columns, values, value))
+
+        # Horizontal growth: the new value of every row covers the most
+        # uncovered interactions, ties going to the least used value
+        used = [0] * levels[factor]
+        for row in rows:
+            best, best_covered = None, []
+            for value in sorted(range(levels[factor]), key=lambda v: used[v]):
+                covered = [interaction for interaction in
+                           ((columns, tuple(row[c] for c in columns), value) for columns in column_sets)
+                           if interaction in uncovered]
+                if best is None or len(covered) > len(best_covered):
+                    best, best_covered = value, covered
+            row.append(best)
+            used[best] += 1
+            uncovered.difference_update(best_covered)
+
+        # Vertical growth: every interaction left goes into the first row
+        # whose free (None) positions can take it, or into a new row
+        for columns, values, value in sorted(uncovered):
+            wanted = list(zip(columns, values)) + [(factor, value)]
+            for row in free_rows:
+                if all(row[c] is None or row[c] == v for c, v in wanted):
+                    break
+            else:
+                row = [None] * (factor + 1)
+                rows.append(row)
+                free_rows.append(row)
+            for c, v in wanted:
+                row[c] = v
+        free_rows = [row for row in free_rows if None in row]
+
+    # Positions no interaction needed: spread the values evenly
+    for i, row in enumerate(rows):
+        for c, value in enumerate(row):
+            if value is None:
+                row[c] = i % levels[c]
+    return rows
+
+def uncovered_interactions(rows, levels, strength):
+    """The number of `strength`-way interactions no row covers, and the number of interactions in all."""
+    strength = min(strength, len(levels))
+    seen = 0
+    for columns in itertools.combinations(range(len(levels)), strength):
+        seen += len({tuple(row[c] for c in columns) for row in rows})
+    total = count_interactions(levels, strength)
+    return total - seen, total
@@ -0,0 +1,330 @@
+#!/usr/bin/env python3
+"""
+The key database: every key name the testers understand, with what each
+encoder needs to know about it.
+
+Columns of a key:
+
+  name         Key name as passed with --key
+  keycode      evdev keycode in the US QWERTY layout (None if unknown)
+  kitty        GLFW key of kitty: a character or a GLFW_FKEY_* / PUA value
+  shifted      Character the key produces with Shift, if different
+  text         Character the key types (far2l); defaults to `kitty` for characters
+  numpad_text  Text of a keypad key with NumLock on (kitty)
+  gdk          GDK keyval: a character or a GDK_KEY_* name
+  vk           Windows virtual key code: a character or a VK_* name
+  base_key     Key in the US layout, for keys of other layouts
+  matrix       Part of the run_tests.py / difftest combination matrix
+  key_class    letters (text keys), functional, keypad or non_ascii; the
+               classes difftest/bench.cc times separately
+
+A tester only knows the keys that have its column set, plus keys named by
+codepoint ("U+XXXX") that every tester synthesises itself; run_tests.py
+--unicode-sweep takes those from unicode_sweep_keys(). run_tests.py
+imports the matrix keys from here; the C/C++ testers include tables
+generated at build time:
+
+  python3 common/key_db.py <kitty|vte|far2l|matrix> <output.inc>
+
+The kitty, vte and far2l tables are perfect hash tables over the key names
+(looked up with kt_key_slot() of kt_keydb.h), the matrix table is the body
+of TEST_KEYS in difftest/test_matrix.h.
+"""
+import itertools
+import sys
+import unicodedata
+
+class Key:
+    def __init__(self, name, keycode=None, *, kitty=None, shifted=None, text=None, numpad_text=None,
+                 gdk=None, vk=None, base_key=None, matrix=False, key_class='functional'):
+        self.name = name
+        self.keycode = keycode
+        self.kitty = kitty
+        self.shifted = shifted
+        self.text = text if text is not None else (kitty if isinstance(kitty, str) and len(kitty) == 1 else None)
+        self.numpad_text = numpad_text
+        self.gdk = gdk
+        self.vk = vk
+        self.base_key = base_key
+        self.matrix = matrix
+        self.key_class = key_class
+
+LETTER_KEYCODES = {
+    'a': 38, 'b': 56, 'c': 54, 'd': 40, 'e': 26, 'f': 41, 'g': 42, 'h': 43, 'i': 31,
+    'j': 44, 'k': 45, 'l': 46, 'm': 58, 'n': 57, 'o': 32, 'p': 33, 'q': 24, 'r': 27,
+    's': 39, 't': 28, 'u': 30, 'v': 55, 'w': 25, 'x': 53, 'y': 29, 'z': 52,
+}
+DIGIT_SHIFTED = ")!@#$%^&*("
+
+# Punctuation keys: keycode, character, shifted character, the name the
+# matrix tests the unshifted key by (None: the character itself), GDK
+# keyvals of both characters, virtual key
+PUNCTUATION = [
+    (49, '`', '~', None, 'GDK_KEY_grave', 'GDK_KEY_asciitilde', 'VK_OEM_3'),
+    (20, '-', '_', 'minus', 'GDK_KEY_minus', 'GDK_KEY_underscore', 'VK_OEM_MINUS'),
+    (21, '=', '+', 'equal', 'GDK_KEY_equal', 'GDK_KEY_plus', 'VK_OEM_PLUS'),
+    (34, '[', '{', 'bracketleft', 'GDK_KEY_bracketleft', 'GDK_KEY_braceleft', 'VK_OEM_4'),
+    (35, ']', '}', 'bracketright', 'GDK_KEY_bracketright', 'GDK_KEY_braceright', 'VK_OEM_6'),
+    (51, '\\', '|', 'backslash', 'GDK_KEY_backslash', 'GDK_KEY_bar', 'VK_OEM_5'),
+    (47, ';', ':', 'semicolon', 'GDK_KEY_semicolon', 'GDK_KEY_colon', 'VK_OEM_1'),
+    (48, "'", '"', 'apostrophe', 'GDK_KEY_apostrophe', 'GDK_KEY_quotedbl', 'VK_OEM_7'),
+    (59, ',', '<', 'comma', 'GDK_KEY_comma', 'GDK_KEY_less', 'VK_OEM_COMMA'),
+    (60, '.', '>', 'period', 'GDK_KEY_period', 'GDK_KEY_greater', 'VK_OEM_PERIOD'),
+    (61, '/', '?', 'slash', 'GDK_KEY_slash', 'GDK_KEY_question', 'VK_OEM_2'),
+]
+
+# Keypad keys outside the matrix: name, kitty key, NumLock text, text, virtual key
+KEYPAD = [
+    ('KP_Decimal', 57409, '.', None, 'VK_DECIMAL'),
+    ('KP_Divide', 57410, '/', '/', 'VK_DIVIDE'),
+    ('KP_Multiply', 57411, '*', '*', 'VK_MULTIPLY'),
+    ('KP_Subtract', 57412, '-', '-', 'VK_SUBTRACT'),
+    ('KP_Add', 57413, '+', '+', 'VK_ADD'),
+    ('KP_Enter', 57414, '\r', None, None), # far2l sends VK_RETURN with ENHANCED_KEY, see far2l_encoder.cpp
+    ('KP_Equal', 57415, '=', None, None),
+    ('KP_Separator', 57416, ',', None, 'VK_SEPARATOR'),
+    ('KP_Left', 57417, None, None, 'VK_LEFT'),
+    ('KP_Right', 57418, None, None, 'VK_RIGHT'),
+    ('KP_Up', 57419, None, None, 'VK_UP'),
+    ('KP_Down', 57420, None, None, 'VK_DOWN'),
+    ('KP_Page_Up', 57421, None, None, 'VK_PRIOR'),
+    ('KP_Page_Down', 57422, None, None, 'VK_NEXT'),
+    ('KP_Insert', 57425, None, None, 'VK_INSERT'),
+    ('KP_Delete', 57426, None, None, 'VK_DELETE'),
+    ('KP_Begin', 57427, None, None, 'VK_CLEAR'),
+]
+
+def build_keys():
+    # Matrix keys first, in matrix order
+    keys = []
+    extra = []
+
+    for c, keycode in LETTER_KEYCODES.items():
+        keys.append(Key(c, keycode, kitty=c, shifted=c.upper(), gdk=c, vk=c.upper(), matrix=True, key_class='letters'))
+
+    for c in "1234567890":
+        keys.append(Key(c, 10 + (int(c) + 9) % 10, kitty=c, shifted=DIGIT_SHIFTED[int(c)], gdk=c, vk=c, matrix=True,
+                        key_class='letters'))
+
+    for keycode, c, shifted, name, gdk, shifted_gdk, vk in PUNCTUATION:
+        common = dict(kitty=c, shifted=shifted, vk=vk, matrix=True, key_class='letters')
+        keys.append(Key(name or c, keycode, gdk=gdk, **common))
+        keys.append(Key(shifted, keycode, gdk=shifted_gdk, **common))
+        if name:
+            extra.append(Key(c, keycode, kitty=c, shifted=shifted, gdk=gdk, vk=vk))
+
+    # Function keys (F1=67 in evdev)
+    for i in range(1, 13):
+        keys.append(Key(f"F{i}", 66 + i, kitty=f"GLFW_FKEY_F{i}", gdk=f"GDK_KEY_F{i}", vk=f"VK_F{i}", matrix=True))
+
+    keys += [
+        # Control keys
+        Key('Escape', 9, kitty='GLFW_FKEY_ESCAPE', gdk='GDK_KEY_Escape', vk='VK_ESCAPE', matrix=True),
+        Key('Tab', 23, kitty='GLFW_FKEY_TAB', text='\t', gdk='GDK_KEY_Tab', vk='VK_TAB', matrix=True),
+        Key('Return', 36, kitty='GLFW_FKEY_ENTER', text='\r', gdk='GDK_KEY_Return', vk='VK_RETURN', matrix=True),
+        Key('BackSpace', 22, kitty='GLFW_FKEY_BACKSPACE', text='\x08', gdk='GDK_KEY_BackSpace', vk='VK_BACK', matrix=True),
+        Key('space', 65, kitty=' ', shifted=' ', gdk='GDK_KEY_space', vk='VK_SPACE', matrix=True),
+        # Navigation
+        Key('Insert', 118, kitty='GLFW_FKEY_INSERT', gdk='GDK_KEY_Insert', vk='VK_INSERT', matrix=True),
+        Key('Delete', 119, kitty='GLFW_FKEY_DELETE', gdk='GDK_KEY_Delete', vk='VK_DELETE', matrix=True),
+        Key('Home', 110, kitty='GLFW_FKEY_HOME', gdk='GDK_KEY_Home', vk='VK_HOME', matrix=True),
+        Key('End', 115, kitty='GLFW_FKEY_END', gdk='GDK_KEY_End', vk='VK_END', matrix=True),
+        Key('Page_Up', 112, kitty='GLFW_FKEY_PAGE_UP', gdk='GDK_KEY_Page_Up', vk='VK_PRIOR', matrix=True),
+        Key('Page_Down', 117, kitty='GLFW_FKEY_PAGE_DOWN', gdk='GDK_KEY_Page_Down', vk='VK_NEXT', matrix=True),
+        # Arrows
+        Key('Up', 111, kitty='GLFW_FKEY_UP', gdk='GDK_KEY_Up', vk='VK_UP', matrix=True),
+        Key('Down', 116, kitty='GLFW_FKEY_DOWN', gdk='GDK_KEY_Down', vk='VK_DOWN', matrix=True),
+        Key('Left', 113, kitty='GLFW_FKEY_LEFT', gdk='GDK_KEY_Left', vk='VK_LEFT', matrix=True),
+        Key('Right', 114, kitty='GLFW_FKEY_RIGHT', gdk='GDK_KEY_Right', vk='VK_RIGHT', matrix=True),
+    ]
+
+    # Keypad (the matrix keycodes are those run_tests.py always used)
+    for i in range(10):
+        keys.append(Key(f"KP_{i}", 90 if i == 0 else 77 + i, kitty=57399 + i, numpad_text=str(i),
+                        gdk=f"GDK_KEY_KP_{i}", vk=f"VK_NUMPAD{i}", matrix=True, key_class='keypad'))
+    keys.append(Key('KP_Home', 79, kitty=57423, gdk='GDK_KEY_KP_Home', vk='VK_HOME', matrix=True, key_class='keypad'))
+    keys.append(Key('KP_End', 87, kitty=57424, gdk='GDK_KEY_KP_End', vk='VK_END', matrix=True, key_class='keypad'))
+    for name, kitty, numpad_text, text, vk in KEYPAD:
+        extra.append(Key(name, kitty=kitty, numpad_text=numpad_text, text=text, gdk=f"GDK_KEY_{name}", vk=vk))
+
+    # Non-English: 'я' is on the physical 'z' key (keycode 52) of the Russian layout
+    keys.append(Key('я', 52, kitty='я', shifted='Я', gdk='GDK_KEY_Cyrillic_ya', vk='Z', base_key='z', matrix=True,
+                    key_class='non_ascii'))
+    extra.append(Key('Я', 52, gdk='GDK_KEY_Cyrillic_YA', base_key='z'))
+
+    return keys + extra
+
+KEYS = build_keys()
+
+def matrix_keys():
+    """The keys of the combination matrix as run_tests.py key_info dicts."""
+    keys = []
+    for k in KEYS:
+        if k.matrix:
+            key_info = {'name': k.name, 'keycode': k.keycode}
+            if k.base_key:
+                key_info['base_key'] = k.base_key
+            keys.append(key_info)
+    return keys
+
+# The Unicode sweep types every character on the physical 'a' key, so that
+# the base layout key (and VTE's keycode) is the same for all of them
+SWEEP_KEYCODE = LETTER_KEYCODES['a']
+SWEEP_BASE_KEY = 'a'
+# Every n-th astral codepoint with a case mapping is swept, and these without one:
+# MATHEMATICAL BOLD CAPITAL A, GRINNING FACE, the first CJK Extension B ideograph
+ASTRAL_SAMPLE_STRIDE = 8
+ASTRAL_UNCASED_SAMPLE = [0x1D400, 0x1F600, 0x20000]
+
+def case_mapped(cp):
+    """The single codepoint Shift makes of `cp` (None if there is none), or False without a case mapping."""
+    c = chr(cp)
+    upper, lower = c.upper(), c.lower()
+    if len(upper) == 1 and upper != c:
+        return ord(upper)
+    return None if len(lower) == 1 and lower != c else False
+
+def unicode_sweep_keys():
+    """The keys of run_tests.py --unicode-sweep as key_info dicts, in codepoint order.
+
+    Every non-ASCII BMP codepoint with a single-codepoint case mapping (in the
+    Unicode version of this Python), then a sample of astral codepoints. The
+    testers get them as "U+XXXX" with the uppercase character as shifted key.
+    """
+    astral = [cp for cp in range(0x10000, 0x110000) if case_mapped(cp) is not False][::ASTRAL_SAMPLE_STRIDE]
+    codepoints = [cp for cp in range(0x80, 0x10000) if not 0xD800 <= cp < 0xE000 and case_mapped(cp) is not False]
+    keys = []
+    for cp in codepoints + sorted(astral + ASTRAL_UNCASED_SAMPLE):
+        key_info = {'name': chr(cp), 'arg': f"U+{cp:04X}", 'keycode': SWEEP_KEYCODE, 'base_key': SWEEP_BASE_KEY}
+        shifted = case_mapped(cp)
+        if shifted:
+            key_info['shifted'] = f"U+{shifted:04X}"
+        keys.append(key_info)
+    return keys
+
+# Perfect hashing: kt_key_hash() and kt_key_slot() of kt_keydb.h
+
+MASK32 = 0xFFFFFFFF
+
+def key_hash(name, seed):
+    h = (2166136261 ^ seed) & MASK32
+    for b in name.encode('utf-8'):
+        h = ((h ^ b) * 16777619) & MASK32
+    h ^= h >> 16
+    h = (h * 0x7FEB352D) & MASK32
+    return h ^ (h >> 15)
+
+def perfect_hash(names):
+    """Returns (seeds, slots): a seed per bucket and, per slot, the index of its name.
+
+    A name's bucket is key_hash(name, 0) % len(seeds), its slot
+    key_hash(name, seeds[bucket]) % len(slots). Buckets are placed largest
+    first, each with the first seed that sends its names to free slots.
+    """
+    for slot_count in itertools.count(len(names)):
+        bucket_count = max(1, slot_count // 2)
+        buckets = [[] for _ in range(bucket_count)]
+        for i, name in enumerate(names):
+            buckets[key_hash(name, 0) % bucket_count].append(i)
+        seeds = [0] * bucket_count
+        slots = [None] * slot_count
+        for b in sorted(range(bucket_count), key=lambda b: -len(buckets[b])):
+            for seed in range(1 << 16):
+                positions = [key_hash(names[i], seed) % slot_count for i in buckets[b]]
+                if len(set(positions)) == len(positions) and all(slots[p] is None for p in positions):
+                    break
+            else:
+                break # No seed fits, retry with a larger table
+            seeds[b] = seed
+            for i, p in zip(buckets[b], positions):
+                slots[p] = i
+        else:
+            return seeds, slots
+
+# C output
+
+def c_char(value):
+    """A character as a C character literal, or its code if it has none."""
+    cp = ord(value)
+    if cp >= 0x80:
+        return f"0x{cp:04X}"
+    escapes = {'\\': "\\\\", "'": "\\'", '\t': "\\t", '\r': "\\r", '\x08': "\\b"}
+    if value in escapes:
+        return f"'{escapes[value]}'"
+    if cp < 0x20 or cp == 0x7F:
+        return f"0x{cp:02X}"
+    return f"'{value}'"
+
+def c_string(value):
+    if value is None:
+        return None
+    escaped = value.replace('\\', '\\\\').replace('"', '\\"').replace('\r', '\\r').replace('\t', '\\t')
+    return f'"{escaped}"'
+
+def c_value(value):
+    """Characters become literals, ints stay, other strings are C names."""
+    if value is None:
+        return "0"
+    if isinstance(value, int):
+        return str(value)
+    if len(value) == 1:
+        return c_char(value)
+    return value
+
+# Per table: entry type, whether a key is in it, and its fields after the name
+TABLES = {
+    'kitty': ('KeyInfo', lambda k: k.kitty is not None,
+              lambda k: [c_value(k.kitty), c_value(k.shifted), c_string(k.numpad_text) or "NULL"]),
+    'vte': ('KeyvalEntry', lambda k: k.gdk is not None,
+            lambda k: [c_value(k.gdk)]),
+    'far2l': ('KeyDef', lambda k: k.vk is not None,
+              lambda k: [c_value(k.vk), c_value(k.text), c_value(k.shifted or k.text)]),
+}
+
+HEADER = "// Generated by common/key_db.py from the key database, do not edit\n"
+
+def write_hash_table(table, path):
+    entry_type, selected, fields = TABLES[table]
+    keys = [k for k in KEYS if selected(k)]
+    seeds, slots = perfect_hash([k.name for k in keys])
+    cplusplus = table != 'kitty'
+    qualifier = "static constexpr" if cplusplus else "static const"
+    null = "nullptr" if cplusplus else "NULL"
+    empty = ", ".join([null] + ["0"] * len(fields(keys[0])))
+
+    with open(path, 'w', encoding='utf-8') as f:
+        f.write(HEADER)
+        f.write(f"// {len(keys)} keys; look up with kt_key_slot() of common/kt_keydb.h and compare the name\n\n")
+        f.write(f"enum {{ KEY_TABLE_SLOTS = {len(slots)}, KEY_TABLE_BUCKETS = {len(seeds)} }};\n\n")
+        f.write(f"{qualifier} unsigned short key_table_seeds[KEY_TABLE_BUCKETS] = {{\n")
+        for i in range(0, len(seeds), 16):
+            f.write("    " + ", ".join(str(s) for s in seeds[i:i + 16]) + ",\n")
+        f.write("};\n\n")
+        f.write(f"{qualifier} {entry_type} key_table[KEY_TABLE_SLOTS] = {{\n")
+        for i in slots:
+            if i is None:
+                f.write(f"    {{ {empty} }},\n")
+            else:
+                f.write(f"    {{ {', '.join([c_string(keys[i].name)] + fields(keys[i]))} }},\n")
+        f.write("};\n")
+
+def write_matrix_table(path):
+    with open(path, 'w', encoding='utf-8') as f:
+        f.write(HEADER)
+        for k in KEYS:
+            if k.matrix:
+                base_key = c_string(k.base_key) or "nullptr"
+                f.write(f"    {{ {c_string(k.name)}, {k.keycode}, {base_key}, {c_string(k.key_class)} }},\n")
+
+def main():
+    if len(sys.argv) != 3 or sys.argv[1] not in list(TABLES) + ['matrix']:
+        print(f"Usage: {sys.argv[0]} <{'|'.join(list(TABLES) + ['matrix'])}> <output.inc>", file=sys.stderr)
+        sys.exit(1)
+    table, path = sys.argv[1:]
+    if table == 'matrix':
+        write_matrix_table(path)
+    else:
+        write_hash_table(table, path)
+
+if __name__ == "__main__":
+    main()
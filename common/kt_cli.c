@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 200809L // strtok_r
+
+#include "kt_cli.h"
+#include "kt_coverage.h"
+#include "kt_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int parse_uint(const char* str, unsigned* value) {
+    char* end = NULL;
+    unsigned long v = strtoul(str, &end, 10);
+    if (!str[0] || *end != '\0') return -1;
+    *value = (unsigned)v;
+    return 0;
+}
+
+int kt_parse_args(int argc, char** argv, kt_key_event* ev, char* err, size_t err_size) {
+    memset(ev, 0, sizeof(*ev));
+    ev->action = KT_ACTION_PRESS; // Default
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--key") == 0 && i + 1 < argc) ev->key = argv[++i];
+        else if (strcmp(arg, "--shifted-key") == 0 && i + 1 < argc) ev->shifted_key = argv[++i];
+        else if (strcmp(arg, "--base-key") == 0 && i + 1 < argc) ev->base_key = argv[++i];
+        else if (strcmp(arg, "--layout") == 0 && i + 1 < argc) ev->layout = argv[++i];
+        else if (strcmp(arg, "--shift") == 0) ev->mods |= KT_MOD_SHIFT;
+        else if (strcmp(arg, "--ctrl") == 0) ev->mods |= KT_MOD_CTRL;
+        else if (strcmp(arg, "--alt") == 0) ev->mods |= KT_MOD_ALT;
+        else if (strcmp(arg, "--super") == 0) ev->mods |= KT_MOD_SUPER;
+        else if (strcmp(arg, "--caps") == 0) ev->mods |= KT_MOD_CAPS;
+        else if (strcmp(arg, "--num") == 0) ev->mods |= KT_MOD_NUM;
+        else if (strcmp(arg, "--cursor-key-mode") == 0) ev->cursor_key_mode = 1;
+        else if (strcmp(arg, "--action") == 0 && i + 1 < argc) {
+            const char* action_str = argv[++i];
+            if (strcmp(action_str, "release") == 0) ev->action = KT_ACTION_RELEASE;
+            else if (strcmp(action_str, "repeat") == 0) ev->action = KT_ACTION_REPEAT;
+        }
+        else if (strcmp(arg, "--kitty-flags") == 0 && i + 1 < argc) {
+            if (parse_uint(argv[++i], &ev->kitty_flags) != 0) {
+                snprintf(err, err_size, "Error: Invalid --kitty-flags '%s'.", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(arg, "--keycode") == 0 && i + 1 < argc) {
+            if (parse_uint(argv[++i], &ev->keycode) != 0) {
+                snprintf(err, err_size, "Error: Invalid --keycode '%s'.", argv[i]);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int has_arg(int argc, char** argv, const char* name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+// Parses and encodes one combination. Returns the output length, or -1
+// with the error message in `out`. With --coverage among the arguments,
+// `coverage` receives the hex bitmap of the branches taken, "-" if none.
+// With --trace, `trace` receives the records of the encoder (see kt_trace.h),
+// otherwise it is left empty.
+static int encode_args(int argc, char** argv, kt_encode_fn encode, char* out, size_t out_size, char* coverage, char* trace) {
+    kt_key_event ev;
+    if (kt_parse_args(argc, argv, &ev, out, out_size) != 0) {
+        return -1;
+    }
+    int with_coverage = has_arg(argc, argv, "--coverage");
+    if (with_coverage) kt_coverage(NULL, 0);
+    int with_trace = has_arg(argc, argv, "--trace");
+    kt_trace_dump(NULL, 0);
+
+    int len = encode(&ev, out, out_size);
+
+    if (with_trace) kt_trace_dump(trace, KT_TRACE_TEXT_MAX);
+
+    if (with_coverage) {
+        unsigned char map[KT_COV_MAP_BYTES];
+        size_t used = kt_coverage(map, sizeof(map));
+        for (size_t i = 0; i < used; i++) sprintf(coverage + 2 * i, "%02x", map[i]);
+        if (!used) strcpy(coverage, "-");
+    }
+    return len < 0 ? -1 : len;
+}
+
+int kt_run_once(int argc, char** argv, kt_encode_fn encode) {
+    char out[KT_OUTPUT_MAX];
+    char coverage[KT_COVERAGE_HEX_MAX] = "";
+    char trace[KT_TRACE_TEXT_MAX] = "";
+    int len = encode_args(argc, argv, encode, out, sizeof(out), coverage, trace);
+    if (trace[0]) fprintf(stderr, "[TRACE]\n%s", trace);
+    if (len < 0) {
+        fprintf(stderr, "%s\n", out);
+        return 1;
+    }
+    fwrite(out, 1, len, stdout);
+    if (coverage[0]) fprintf(stderr, "[COVERAGE] %s\n", coverage);
+    return 0;
+}
+
+int kt_run_stream(const char* prog, kt_encode_fn encode) {
+    char line[KT_STREAM_LINE_MAX];
+    while (fgets(line, sizeof(line), stdin)) {
+        size_t line_len = strlen(line);
+        if (line_len == sizeof(line) - 1 && line[line_len - 1] != '\n') {
+            // Too long: answering each piece would shift every later reply
+            int c;
+            while ((c = getchar()) != EOF && c != '\n') {}
+            static const char msg[] = "Error: Request line too long.";
+            printf("ERR %zu\n%s", sizeof(msg) - 1, msg);
+            fflush(stdout);
+            continue;
+        }
+
+        char* args[KT_STREAM_MAX_ARGS];
+        int n = 0;
+        args[n++] = (char*)prog;
+        char* save = NULL;
+        for (char* tok = strtok_r(line, " \t\r\n", &save); tok && n < KT_STREAM_MAX_ARGS; tok = strtok_r(NULL, " \t\r\n", &save)) {
+            args[n++] = tok;
+        }
+
+        char out[KT_OUTPUT_MAX];
+        char coverage[KT_COVERAGE_HEX_MAX] = "";
+        char trace[KT_TRACE_TEXT_MAX] = "";
+        int len = encode_args(n, args, encode, out, sizeof(out), coverage, trace);
+        size_t out_len = len < 0 ? strlen(out) : (size_t)len;
+        size_t trace_len = strlen(trace);
+        printf("%s %zu", len < 0 ? "ERR" : "OK", out_len);
+        if (len >= 0 && coverage[0]) printf(" %s", coverage);
+        if (trace_len) printf(" T%zu", trace_len);
+        printf("\n");
+        fwrite(out, 1, out_len, stdout);
+        fwrite(trace, 1, trace_len, stdout);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Command line and --stream front-end shared by the C/C++ tester binaries.
+ * Every tester main() parses its arguments into a kt_key_event and hands it
+ * to the same kt_encode() that its plugin exports.
+ */
+
+#pragma once
+
+#include "kt_plugin.h"
+#include "kt_coverage.h"
+#include "kt_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Limits for a single --stream request line
+#define KT_STREAM_LINE_MAX 1024
+#define KT_STREAM_MAX_ARGS 64
+
+// Hex coverage bitmap of a --coverage request (see kt_coverage.h)
+#define KT_COVERAGE_HEX_MAX (2 * KT_COV_MAP_BYTES + 1)
+
+// Parses tester arguments (argv[0] is skipped) into `ev`. Unknown arguments
+// are ignored, so testers can add process-wide options of their own.
+// Returns 0, or -1 with a message in `err`.
+int kt_parse_args(int argc, char** argv, kt_key_event* ev, char* err, size_t err_size);
+
+// Runs the combination given on the command line and prints its output.
+// With --coverage, the hex bitmap of the branches taken follows on stderr;
+// with --trace, "[TRACE]" and the encoder's trace records precede it.
+// Returns the process exit code.
+int kt_run_once(int argc, char** argv, kt_encode_fn encode);
+
+// Streaming mode: every stdin line holds the arguments of one combination,
+// separated by whitespace. Each reply is a "OK <len>\n" or "ERR <len>\n"
+// header followed by exactly <len> bytes of output or error message. For a
+// request containing --coverage, the OK header is "OK <len> <hex bitmap>".
+// For a request containing --trace, a "T<n>" token ends the header when the
+// encoder left trace records, and <n> bytes of them follow the output.
+// A line longer than KT_STREAM_LINE_MAX is discarded with one ERR reply.
+int kt_run_stream(const char* prog, kt_encode_fn encode);
+
+#ifdef __cplusplus
+}
+#endif
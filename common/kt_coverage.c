@@ -0,0 +1,16 @@
+#include "kt_coverage.h"
+#include <string.h>
+
+KT_THREAD_LOCAL unsigned char kt_cov_map[KT_COV_MAP_BYTES];
+
+size_t kt_coverage(unsigned char* out, size_t out_size) {
+    size_t used = KT_COV_MAP_BYTES;
+    while (used > 0 && kt_cov_map[used - 1] == 0) used--;
+
+    if (out) {
+        if (used > out_size) used = out_size;
+        memcpy(out, kt_cov_map, used);
+    }
+    memset(kt_cov_map, 0, sizeof(kt_cov_map));
+    return used;
+}
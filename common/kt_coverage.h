@@ -0,0 +1,35 @@
+/*
+ * Branch coverage of the extracted encoder bodies.
+ *
+ * With `make COVERAGE=1` the extraction scripts put a KT_COV_HIT(id) into
+ * every branch of the generated .inc they recognise and list the branches in
+ * <inc>.branches (see coverage_instrument.py). Hits set bits in a per-thread
+ * bitmap, which drivers read back after each kt_encode() call.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "kt_plugin.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Room for 4096 branches
+#define KT_COV_MAP_BYTES 512
+
+extern KT_THREAD_LOCAL unsigned char kt_cov_map[KT_COV_MAP_BYTES];
+
+#define KT_COV_HIT(id) (kt_cov_map[(id) >> 3] |= (unsigned char)(1u << ((id) & 7)))
+
+// Copies the calling thread's bitmap into `out` and clears it. Bit (id & 7)
+// of byte (id >> 3) is set if branch `id` was taken since the previous call.
+// Returns the number of bytes up to the last non-zero one, i.e. 0 if no
+// branch was hit or the encoder is not instrumented. `out` may be NULL to
+// just clear the bitmap. Exported by the C/C++ encoder plugins.
+KT_EXPORT size_t kt_coverage(unsigned char* out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
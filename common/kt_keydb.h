@@ -0,0 +1,54 @@
+/*
+ * Lookup in the key tables generated from common/key_db.py, and of key names
+ * given by codepoint.
+ *
+ * Each table is a minimal perfect hash over the key names it holds: a name
+ * picks a bucket with seed 0, the bucket's seed picks the slot. Names that
+ * are not in the table land on some slot too, so callers compare the slot's
+ * name. Usable from C and, at compile time, from C++.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#define KT_KEYDB_CONSTEXPR constexpr
+#else
+#define KT_KEYDB_CONSTEXPR
+#endif
+
+// FNV-1a from a seeded basis with a final mix; key_hash() in key_db.py
+static inline KT_KEYDB_CONSTEXPR uint32_t kt_key_hash(const char* name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (; *name; ++name) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    return h ^ (h >> 15);
+}
+
+static inline KT_KEYDB_CONSTEXPR size_t kt_key_slot(const char* name, const unsigned short* seeds,
+                                                    size_t buckets, size_t slots) {
+    return kt_key_hash(name, seeds[kt_key_hash(name, 0) % buckets]) % slots;
+}
+
+// The codepoint of a key name of the form "U+XXXX", or 0 for other names.
+// Such names stand for whatever key types that character: keys of non-US
+// layouts and the keys of run_tests.py --unicode-sweep.
+static inline KT_KEYDB_CONSTEXPR uint32_t kt_key_codepoint(const char* name) {
+    if (!name || name[0] != 'U' || name[1] != '+' || !name[2]) return 0;
+    uint32_t cp = 0;
+    for (name += 2; *name; ++name) {
+        char c = *name;
+        uint32_t digit = c >= '0' && c <= '9' ? (uint32_t)(c - '0')
+                       : c >= 'A' && c <= 'F' ? (uint32_t)(c - 'A' + 10)
+                       : c >= 'a' && c <= 'f' ? (uint32_t)(c - 'a' + 10) : 16;
+        if (digit == 16) return 0;
+        cp = cp * 16 + digit;
+        if (cp > 0x10FFFF) return 0;
+    }
+    return cp;
+}
@@ -0,0 +1,73 @@
+/*
+ * Uniform C entry point exported by every encoder plugin.
+ *
+ * Each tester's encoder is also built as a shared object (build/lib/libkt_*.so)
+ * exporting kt_encode(). Drivers such as difftest dlopen() a reference and a
+ * target plugin and compare them in-process, without spawning testers or
+ * parsing their stdout.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KT_PLUGIN_ABI_VERSION 1
+
+#define KT_EXPORT __attribute__((visibility("default")))
+
+// Per-thread state of the encoders, such as the coverage bitmap and trace ring
+#ifdef __cplusplus
+#define KT_THREAD_LOCAL thread_local
+#else
+#define KT_THREAD_LOCAL _Thread_local
+#endif
+
+// Modifiers and lock states (kt_key_event.mods)
+#define KT_MOD_SHIFT    0x01
+#define KT_MOD_CTRL     0x02
+#define KT_MOD_ALT      0x04
+#define KT_MOD_SUPER    0x08
+#define KT_MOD_CAPS     0x10
+#define KT_MOD_NUM      0x20
+
+// Key actions (kt_key_event.action)
+#define KT_ACTION_RELEASE   0
+#define KT_ACTION_PRESS     1
+#define KT_ACTION_REPEAT    2
+
+// Returned by kt_encode() when the event cannot be encoded
+#define KT_ENCODE_ERROR     -1
+
+// Large enough for any sequence the encoders produce
+#define KT_OUTPUT_MAX       256
+
+// Neutral description of one key event, mirroring the tester command line
+typedef struct {
+    const char* key;          // Key name as used by run_tests.py, or "U+XXXX"
+    const char* shifted_key;  // "U+XXXX" shifted codepoint of a codepoint key, or NULL
+    const char* base_key;     // Key in the base (US) layout, or NULL
+    const char* layout;       // xkb layout the key belongs to, or NULL for us
+    unsigned keycode;         // evdev keycode, 0 if unknown
+    unsigned mods;            // KT_MOD_* bits
+    int action;               // KT_ACTION_*
+    unsigned kitty_flags;     // kitty keyboard protocol flags
+    int cursor_key_mode;      // DECCKM state
+} kt_key_event;
+
+// Encodes `ev` into `out` exactly as the tester binary would print it,
+// including markers such as "[EMPTY]" or "[LEGACY_FALLBACK]". Returns the
+// number of bytes written, or KT_ENCODE_ERROR with a NUL-terminated error
+// message in `out`.
+typedef int (*kt_encode_fn)(const kt_key_event* ev, char* out, size_t out_size);
+
+KT_EXPORT int kt_encode(const kt_key_event* ev, char* out, size_t out_size);
+KT_EXPORT int kt_abi_version(void);
+KT_EXPORT const char* kt_name(void);
+
+#ifdef __cplusplus
+}
+#endif
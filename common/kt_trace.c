@@ -0,0 +1,58 @@
+#include "kt_trace.h"
+#include <stdio.h>
+
+#ifdef KT_TRACE_ENABLED
+
+typedef struct {
+    const char* fmt;
+    unsigned args[KT_TRACE_ARGS];
+} kt_trace_entry;
+
+static KT_THREAD_LOCAL kt_trace_entry kt_trace_ring[KT_TRACE_RING];
+static KT_THREAD_LOCAL size_t kt_trace_count; // Records since the last dump
+
+void kt_trace_record(const char* fmt, unsigned a0, unsigned a1, unsigned a2, unsigned a3, unsigned a4, unsigned a5) {
+    kt_trace_entry* e = &kt_trace_ring[kt_trace_count++ % KT_TRACE_RING];
+    e->fmt = fmt;
+    e->args[0] = a0;
+    e->args[1] = a1;
+    e->args[2] = a2;
+    e->args[3] = a3;
+    e->args[4] = a4;
+    e->args[5] = a5;
+}
+
+size_t kt_trace_dump(char* out, size_t out_size) {
+    size_t count = kt_trace_count;
+    kt_trace_count = 0;
+    if (!out || !out_size) return 0;
+
+    size_t used = 0;
+    size_t first = count > KT_TRACE_RING ? count - KT_TRACE_RING : 0;
+    out[0] = '\0';
+    if (first) {
+        int n = snprintf(out, out_size, "(%zu earlier records dropped)\n", first);
+        used = n < 0 ? 0 : (size_t)n;
+    }
+    for (size_t i = first; i < count && used + 1 < out_size; i++) {
+        const kt_trace_entry* e = &kt_trace_ring[i % KT_TRACE_RING];
+        int n = snprintf(out + used, out_size - used, e->fmt,
+                         e->args[0], e->args[1], e->args[2], e->args[3], e->args[4], e->args[5]);
+        if (n < 0) break;
+        used += (size_t)n;
+        if (used + 1 < out_size) {
+            out[used++] = '\n';
+            out[used] = '\0';
+        }
+    }
+    return used < out_size ? used : out_size - 1;
+}
+
+#else
+
+size_t kt_trace_dump(char* out, size_t out_size) {
+    if (out && out_size) out[0] = '\0';
+    return 0;
+}
+
+#endif
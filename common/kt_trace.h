@@ -0,0 +1,50 @@
+/*
+ * Trace records of the encoders.
+ *
+ * KT_TRACE(fmt, ...) takes a printf format with up to KT_TRACE_ARGS
+ * unsigned conversions (%u, %x, %c) and as many integer arguments. In a
+ * `make TRACE=1` build, which defines KT_TRACE_ENABLED, it stores the format
+ * pointer and the arguments in a per-thread ring buffer; nothing is
+ * formatted until a driver asks for the records of a combination that
+ * failed. In other builds it compiles to nothing.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "kt_plugin.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KT_TRACE_ARGS 6
+// Records kept per thread; older ones are dropped
+#define KT_TRACE_RING 64
+// Room for the formatted records of one event
+#define KT_TRACE_TEXT_MAX 4096
+
+#ifdef KT_TRACE_ENABLED
+
+void kt_trace_record(const char* fmt, unsigned a0, unsigned a1, unsigned a2, unsigned a3, unsigned a4, unsigned a5);
+
+#define KT_TRACE(...) KT_TRACE_PAD(__VA_ARGS__, 0, 0, 0, 0, 0, 0, 0)
+#define KT_TRACE_PAD(fmt, a0, a1, a2, a3, a4, a5, ...) \
+    kt_trace_record(fmt, (unsigned)(a0), (unsigned)(a1), (unsigned)(a2), (unsigned)(a3), (unsigned)(a4), (unsigned)(a5))
+
+#else
+
+#define KT_TRACE(...) ((void)0)
+
+#endif
+
+// Formats the calling thread's records, oldest first and one per line, into
+// `out` (NUL-terminated, truncated to `out_size`) and clears them. Returns
+// the length written, 0 if nothing was recorded or tracing is compiled out.
+// `out` may be NULL to just clear the records. Exported by the C/C++
+// encoder plugins.
+KT_EXPORT size_t kt_trace_dump(char* out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
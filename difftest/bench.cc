@@ -0,0 +1,337 @@
+// Micro-benchmarks of the extracted encoders. Times kt_encode() of each
+// plugin, i.e. encode_glfw_key_event(), TesterTerminal::widget_key_press()
+// or VT_TranslateKeyToKitty() behind its key name lookup, per key class and
+// kitty flags set. Writes the results as JSON and compares them with a
+// baseline written by an earlier run. Built with optimization by 'make bench'.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "encoder_plugin.h"
+#include "test_matrix.h"
+
+#ifndef KT_PLUGIN_DIR
+#define KT_PLUGIN_DIR "./build/lib"
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static const double WARMUP_NS = 20e6;
+
+struct BenchOptions {
+    std::vector<std::string> plugins;
+    unsigned repetitions = 5;
+    double min_time_ns = 50e6;  // Per repetition
+    std::string json = "bench_results.json";
+    std::string baseline;
+    double threshold = 10;      // Percent
+};
+
+struct FlagSet {
+    const char* name;
+    unsigned flags;
+};
+
+static const FlagSet FLAG_SETS[] = {
+    { "legacy", 0 },
+    { "disambiguate", 1 },
+    { "report_all_keys", 8 },
+    { "all", 31 },
+};
+
+// Keys of other layouts: kitty reads the codepoint, VTE the keycode in the layout
+struct NonAsciiKey {
+    const char* name;
+    const char* layout;
+    unsigned keycode;
+    const char* base_key;
+};
+
+static const NonAsciiKey NON_ASCII_KEYS[] = {
+    { "U+0444", "ru", 38, "a" },  // ф
+    { "U+044F", "ru", 52, "z" },  // я
+    { "U+00F6", "de", 47, ";" },  // ö
+    { "U+00E4", "de", 48, "'" },  // ä
+};
+
+static const char* const KEY_CLASSES[] = { "letters", "functional", "keypad", "non_ascii" };
+
+// The events of a key class: each of its keys with every modifier and lock
+static std::vector<kt_key_event> class_events(const std::string& key_class, unsigned flags) {
+    std::vector<kt_key_event> keys;
+    // Matrix keys by their class in common/key_db.py
+    for (const TestKey& k : TEST_KEYS) {
+        if (key_class != k.key_class) continue;
+        kt_key_event ev = {};
+        ev.key = k.name;
+        ev.keycode = k.keycode;
+        ev.base_key = k.base_key;
+        keys.push_back(ev);
+    }
+    if (key_class == "non_ascii") {
+        for (const NonAsciiKey& k : NON_ASCII_KEYS) {
+            kt_key_event ev = {};
+            ev.key = k.name;
+            ev.layout = k.layout;
+            ev.keycode = k.keycode;
+            ev.base_key = k.base_key;
+            keys.push_back(ev);
+        }
+    }
+
+    std::vector<kt_key_event> events;
+    for (kt_key_event ev : keys) {
+        for (const TestModifiers& mods : TEST_MODS) {
+            for (const TestModifiers& locks : TEST_LOCKS) {
+                ev.mods = mods.mods | locks.mods;
+                ev.action = KT_ACTION_PRESS;
+                ev.kitty_flags = flags;
+                events.push_back(ev);
+            }
+        }
+    }
+    return events;
+}
+
+// The upstream function each plugin wraps
+static const char* encoder_function(const std::string& plugin_name) {
+    if (plugin_name == "kitty") return "encode_glfw_key_event";
+    if (plugin_name == "vte") return "TesterTerminal::widget_key_press";
+    if (plugin_name == "far2l") return "VT_TranslateKeyToKitty";
+    return "kt_encode";
+}
+
+struct BenchResult {
+    std::string plugin;
+    std::string function;
+    std::string key_class;
+    std::string flags;
+    size_t events = 0;
+    double ns_per_event = 0;  // Median over the repetitions
+    double ns_min = 0;
+    double ns_max = 0;
+    double vs_legacy = 0;     // ns_per_event relative to the legacy flags set
+};
+
+static volatile int sink;
+
+// Encodes all `events` `passes` times, returns ns per event
+static double time_passes(const EncoderPlugin& plugin, const std::vector<kt_key_event>& events, size_t passes) {
+    char out[KT_OUTPUT_MAX];
+    int total = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t p = 0; p < passes; ++p) {
+        for (const kt_key_event& ev : events) total += plugin.encode_raw(ev, out, sizeof(out));
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    sink = total;
+    return ns / (double)(passes * events.size());
+}
+
+// Returns false if the plugin rejects every event, e.g. keys it has no name for
+static bool run_benchmark(const EncoderPlugin& plugin, const std::vector<kt_key_event>& events,
+                          const BenchOptions& opts, BenchResult& result) {
+    char out[KT_OUTPUT_MAX];
+    bool accepted = false;
+    for (const kt_key_event& ev : events) {
+        if (plugin.encode_raw(ev, out, sizeof(out)) >= 0) accepted = true;
+    }
+    if (!accepted) return false;
+
+    // Warm up caches and branch predictors, and find how many passes over
+    // the events make a repetition of at least min_time_ns
+    size_t passes = 1;
+    double ns_per_event = 0;
+    for (double spent = 0; spent < WARMUP_NS; passes *= 2) {
+        ns_per_event = time_passes(plugin, events, passes);
+        spent += ns_per_event * passes * events.size();
+    }
+    passes = std::max<size_t>(1, (size_t)(opts.min_time_ns / (ns_per_event * events.size())));
+
+    std::vector<double> samples;
+    for (unsigned r = 0; r < opts.repetitions; ++r) samples.push_back(time_passes(plugin, events, passes));
+    std::sort(samples.begin(), samples.end());
+
+    result.events = events.size();
+    result.ns_per_event = samples[samples.size() / 2];
+    result.ns_min = samples.front();
+    result.ns_max = samples.back();
+    return true;
+}
+
+static std::string format_number(double value, int decimals) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    return buf;
+}
+
+// One benchmark per line, fields in a fixed order, so that result files diff well
+static bool write_json(const std::string& path, const BenchOptions& opts, const std::vector<BenchResult>& results) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+    f << "{\n  \"repetitions\": " << opts.repetitions << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        f << "    {\"plugin\": \"" << r.plugin << "\", \"function\": \"" << r.function
+          << "\", \"key_class\": \"" << r.key_class << "\", \"flags\": \"" << r.flags
+          << "\", \"events\": " << r.events
+          << ", \"ns_per_event\": " << format_number(r.ns_per_event, 1)
+          << ", \"ns_min\": " << format_number(r.ns_min, 1)
+          << ", \"ns_max\": " << format_number(r.ns_max, 1)
+          << ", \"events_per_sec\": " << format_number(1e9 / r.ns_per_event, 0)
+          << ", \"vs_legacy\": " << format_number(r.vs_legacy, 3) << "}"
+          << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    f << "  ]\n}\n";
+    return bool(f);
+}
+
+// Value of `"name": ...` in a line written by write_json()
+static std::string json_field(const std::string& line, const std::string& name) {
+    std::string pattern = "\"" + name + "\": ";
+    size_t start = line.find(pattern);
+    if (start == std::string::npos) return std::string();
+    start += pattern.size();
+    if (line[start] == '"') {
+        size_t end = line.find('"', start + 1);
+        return line.substr(start + 1, end - start - 1);
+    }
+    size_t end = line.find_first_of(",}", start);
+    return line.substr(start, end - start);
+}
+
+static std::string bench_id(const std::string& plugin, const std::string& key_class, const std::string& flags) {
+    return plugin + " " + key_class + "/" + flags;
+}
+
+// Prints every benchmark next to its baseline. Returns the number of
+// regressions: benchmarks that got slower than `threshold` percent in
+// absolute terms, or relative to the legacy path of the same run.
+static int compare_with_baseline(const std::string& path, const BenchOptions& opts, const std::vector<BenchResult>& results) {
+    std::ifstream f(path);
+    if (!f) {
+        std::cerr << "Error: Cannot read baseline " << path << std::endl;
+        return -1;
+    }
+    std::map<std::string, std::pair<double, double>> baseline;  // ns_per_event, vs_legacy
+    std::string line;
+    for (int line_number = 1; std::getline(f, line); line_number++) {
+        if (line.find("\"plugin\"") == std::string::npos) continue;
+        try {
+            baseline[bench_id(json_field(line, "plugin"), json_field(line, "key_class"), json_field(line, "flags"))] =
+                { std::stod(json_field(line, "ns_per_event")), std::stod(json_field(line, "vs_legacy")) };
+        } catch (const std::logic_error&) {
+            // std::stod() of a truncated line or missing field
+            std::cerr << "Error: Malformed baseline " << path << ":" << line_number << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << "\nComparison with " << path << " (threshold " << opts.threshold << "%):" << std::endl;
+    int regressions = 0;
+    double limit = 1 + opts.threshold / 100;
+    for (const BenchResult& r : results) {
+        std::string id = bench_id(r.plugin, r.key_class, r.flags);
+        auto it = baseline.find(id);
+        if (it == baseline.end()) {
+            printf("  %-32s %9.1f ns  (not in baseline)\n", id.c_str(), r.ns_per_event);
+            continue;
+        }
+        double change = r.ns_per_event / it->second.first;
+        double relative_change = r.vs_legacy / it->second.second;
+        bool regression = change > limit || relative_change > limit;
+        regressions += regression;
+        printf("  %-32s %9.1f ns %+7.1f%%  %6.2fx legacy (was %.2fx)%s\n", id.c_str(), r.ns_per_event,
+               (change - 1) * 100, r.vs_legacy, it->second.second, regression ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+static std::string plugin_path(const std::string& name) {
+    if (name.find('/') != std::string::npos) return name;
+    return std::string(KT_PLUGIN_DIR) + "/libkt_" + name + ".so";
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--repetitions N] [--min-time MS] [--json <file>] [--baseline <file>] [--threshold PCT] [<name|path.so>...]" << std::endl;
+    std::cerr << "Benchmarks kitty, vte and far2l unless plugins are given" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--repetitions" && i + 1 < argc) opts.repetitions = std::stoul(argv[++i]);
+            else if (arg == "--min-time" && i + 1 < argc) opts.min_time_ns = std::stod(argv[++i]) * 1e6;
+            else if (arg == "--json" && i + 1 < argc) opts.json = argv[++i];
+            else if (arg == "--baseline" && i + 1 < argc) opts.baseline = argv[++i];
+            else if (arg == "--threshold" && i + 1 < argc) opts.threshold = std::stod(argv[++i]);
+            else if (arg[0] != '-') opts.plugins.push_back(arg);
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!opts.repetitions) opts.repetitions = 1;
+    if (opts.plugins.empty()) opts.plugins = { "kitty", "vte", "far2l" };
+
+    std::vector<BenchResult> results;
+    for (const std::string& name : opts.plugins) {
+        EncoderPlugin plugin;
+        std::string err;
+        if (!plugin.load(plugin_path(name), err)) {
+            std::cerr << "Error: " << err << ". Run 'make' first." << std::endl;
+            return 1;
+        }
+
+        for (const char* key_class : KEY_CLASSES) {
+            double legacy_ns = 0;
+            for (const FlagSet& flag_set : FLAG_SETS) {
+                BenchResult r;
+                r.plugin = plugin.name();
+                r.function = encoder_function(r.plugin);
+                r.key_class = key_class;
+                r.flags = flag_set.name;
+                if (!run_benchmark(plugin, class_events(key_class, flag_set.flags), opts, r)) {
+                    printf("%-8s %-10s %-16s rejected by the encoder, skipped\n", r.plugin.c_str(), key_class, flag_set.name);
+                    break;
+                }
+                if (flag_set.flags == 0) legacy_ns = r.ns_per_event;
+                r.vs_legacy = r.ns_per_event / legacy_ns;
+                printf("%-8s %-10s %-16s %9.1f ns/event %12.0f events/sec %6.2fx legacy\n", r.plugin.c_str(), key_class,
+                       flag_set.name, r.ns_per_event, 1e9 / r.ns_per_event, r.vs_legacy);
+                fflush(stdout);
+                results.push_back(r);
+            }
+        }
+    }
+
+    if (!write_json(opts.json, opts, results)) {
+        std::cerr << "Error: Cannot write " << opts.json << std::endl;
+        return 1;
+    }
+    std::cout << "Results: '" << opts.json << "'" << std::endl;
+
+    if (!opts.baseline.empty()) {
+        int regressions = compare_with_baseline(opts.baseline, opts, results);
+        if (regressions < 0) return 1;
+        if (regressions) {
+            std::cout << regressions << " benchmarks regressed" << std::endl;
+            return 1;
+        }
+        std::cout << "No regressions" << std::endl;
+    }
+    return 0;
+}
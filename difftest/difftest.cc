@@ -0,0 +1,253 @@
+// Native differential driver: loads a reference and a target encoder plugin
+// and runs the run_tests.py combination matrix through both in-process.
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "encoder_plugin.h"
+#include "executor.h"
+#include "golden.h"
+#include "report.h"
+#include "test_matrix.h"
+
+static const char* RESULTS_FILE = "test_results.json";
+static const char* MISMATCH_LOG_FILE = "mismatches.log";
+static const char* PLUGIN_DIR = "./build/lib";
+static const size_t CHUNK_SIZE = 256;
+static const size_t PROGRESS_INTERVAL = 500;
+
+struct Options {
+    std::string reference = "kitty";
+    std::string target = "vte";
+    size_t limit = 0;
+    int start_at_percent = 0;
+    unsigned shard_index = 0;  // 1-based, 0 when not sharded
+    unsigned shard_count = 0;
+    unsigned jobs = std::thread::hardware_concurrency();
+    std::string generate_golden;
+    std::string golden_label;
+    std::string trace;
+    bool debug = false;
+};
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--target <name|path.so>] [--reference <name|path.so>] [--limit N] [--start-at-percent P | --shard i/N] [--jobs N] [--trace <file>] [--debug]" << std::endl;
+    std::cerr << "       " << prog << " --generate-golden <file> [--golden-label <text>] [--reference <name|path.so>] [--limit N] [--jobs N]" << std::endl;
+    std::cerr << "Plugins given by name are loaded from " << PLUGIN_DIR << "/libkt_<name>.so" << std::endl;
+}
+
+static std::string plugin_path(const std::string& name) {
+    if (name.find('/') != std::string::npos) return name;
+    return std::string(PLUGIN_DIR) + "/libkt_" + name + ".so";
+}
+
+static bool parse_options(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--target" && i + 1 < argc) opts.target = argv[++i];
+        else if (arg == "--reference" && i + 1 < argc) opts.reference = argv[++i];
+        else if (arg == "--limit" && i + 1 < argc) opts.limit = std::stoul(argv[++i]);
+        else if (arg == "--start-at-percent" && i + 1 < argc) opts.start_at_percent = std::stoi(argv[++i]);
+        else if (arg == "--shard" && i + 1 < argc) {
+            char extra;
+            if (sscanf(argv[++i], "%u/%u%c", &opts.shard_index, &opts.shard_count, &extra) != 2 ||
+                opts.shard_index < 1 || opts.shard_index > opts.shard_count) {
+                return false;
+            }
+        }
+        else if (arg == "--jobs" && i + 1 < argc) opts.jobs = std::stoul(argv[++i]);
+        else if (arg == "--generate-golden" && i + 1 < argc) opts.generate_golden = argv[++i];
+        else if (arg == "--golden-label" && i + 1 < argc) opts.golden_label = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc) opts.trace = argv[++i];
+        else if (arg == "--debug") opts.debug = true;
+        else return false;
+    }
+    if (opts.shard_count && opts.start_at_percent) return false;
+    // Binary golden files cannot be merged; generating one takes about a second anyway
+    if (opts.shard_count && !opts.generate_golden.empty()) return false;
+    return true;
+}
+
+// Mirrors shard_path() in run_tests.py: test_results.json -> test_results.shard2of4.json
+static std::string shard_path(const std::string& path, const Options& opts) {
+    if (!opts.shard_count) return path;
+    size_t dot = path.rfind('.');
+    return path.substr(0, dot) + ".shard" + std::to_string(opts.shard_index) + "of" +
+           std::to_string(opts.shard_count) + path.substr(dot);
+}
+
+// Mirrors format_key_combo() in run_tests.py
+static std::string format_key_combo(const TestCombination& c) {
+    std::string combo;
+    for (const char* part : { c.mods->combo, c.locks->combo }) {
+        if (*part) combo += std::string(part) + "+";
+    }
+    combo += c.key->name;
+    return "Key: " + combo + ", Flags: " + std::to_string(c.flags);
+}
+
+// Writes the reference output of combinations [start_index, end_index) to a
+// binary golden file (see golden.h)
+static int generate_golden(const EncoderPlugin& reference, const Options& opts, size_t start_index, size_t end_index) {
+    std::cout << "Generating golden rules file: " << opts.generate_golden << std::endl;
+    std::cout << "Total combinations: " << end_index - start_index << std::endl;
+
+    std::vector<std::string> outputs(end_index - start_index);
+    Executor executor(opts.jobs, CHUNK_SIZE);
+    executor.run(outputs.size(), [&](size_t begin, size_t end) {
+        for (size_t n = begin; n < end; ++n) {
+            outputs[n] = reference.encode(test_combination(start_index + n).event());
+        }
+    });
+
+    GoldenWriter writer(opts.golden_label);
+    for (size_t n = 0; n < outputs.size(); ++n) {
+        TestCombination c = test_combination(start_index + n);
+        writer.add(c.input_args(), c.flags, outputs[n]);
+    }
+    if (!writer.write(opts.generate_golden)) {
+        std::cout << "Error writing to file: " << opts.generate_golden << std::endl;
+        return 1;
+    }
+    std::cout << "Done. Golden rules saved to '" << opts.generate_golden << "'." << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        if (!parse_options(argc, argv, opts)) {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception&) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    EncoderPlugin reference, target;
+    std::string err;
+    bool golden = !opts.generate_golden.empty();
+    if (!reference.load(plugin_path(opts.reference), err) || (!golden && !target.load(plugin_path(opts.target), err))) {
+        std::cerr << "Error: " << err << ". Run 'make' first." << std::endl;
+        return 1;
+    }
+
+    // The encoders report setup failures on stderr. Like run_tests.py, only
+    // show them with --debug.
+    if (!opts.debug) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDERR_FILENO);
+            close(devnull);
+        }
+    }
+
+    size_t total_tests = TEST_COMBINATION_COUNT;
+    if (opts.limit > 0 && opts.limit < total_tests) total_tests = opts.limit;
+
+    size_t start_index = 0;
+    size_t end_index = total_tests;
+    if (opts.start_at_percent > 0 && opts.start_at_percent < 100) {
+        start_index = (total_tests * opts.start_at_percent) / 100;
+        std::cout << "Starting at " << opts.start_at_percent << "%, skipping first " << start_index << " combinations." << std::endl;
+    } else if (opts.shard_count) {
+        // Contiguous, balanced slices, same as shard_slice() in run_tests.py
+        start_index = total_tests * (opts.shard_index - 1) / opts.shard_count;
+        end_index = total_tests * opts.shard_index / opts.shard_count;
+        std::cout << "Shard " << opts.shard_index << "/" << opts.shard_count << ": combinations "
+                  << start_index << ".." << (long long)end_index - 1 << "." << std::endl;
+    }
+
+    if (golden) {
+        return generate_golden(reference, opts, start_index, end_index);
+    }
+
+    const std::string results_file = shard_path(RESULTS_FILE, opts);
+    const std::string log_file = shard_path(MISMATCH_LOG_FILE, opts);
+
+    std::cout << "Starting tests for target: " << target.name() << std::endl;
+    std::cout << "Combinations to check: " << end_index - start_index << std::endl;
+
+    // Each combination has its own slot, so results come out in matrix
+    // order no matter which worker ran them
+    std::vector<TestResult> results(end_index - start_index);
+    std::atomic<size_t> done(0);
+    std::atomic<size_t> mismatch_count(0);
+    std::mutex progress_mutex;
+
+    Executor executor(opts.jobs, CHUNK_SIZE);
+    executor.run(results.size(), [&](size_t begin, size_t end) {
+        size_t chunk_mismatches = 0;
+        for (size_t n = begin; n < end; ++n) {
+            TestCombination c = test_combination(start_index + n);
+            kt_key_event ev = c.event();
+
+            TestResult& r = results[n];
+            r.combo = format_key_combo(c);
+            r.kitty_out = reference.encode(ev);
+            r.target_out = target.encode(ev);
+            r.status = classify(r.kitty_out, r.target_out);
+            if (strcmp(r.status, "mismatch") == 0) chunk_mismatches++;
+            // Only failures pay for tracing, by encoding them a second time
+            if (!opts.trace.empty() && (strcmp(r.status, "mismatch") == 0 || strcmp(r.status, "error") == 0)) {
+                r.kitty_trace = reference.trace(ev);
+                r.target_trace = target.trace(ev);
+            }
+        }
+
+        size_t mismatches = mismatch_count += chunk_mismatches;
+        size_t before = done.fetch_add(end - begin);
+        size_t after = before + (end - begin);
+        if (after / PROGRESS_INTERVAL != before / PROGRESS_INTERVAL) {
+            size_t i = start_index + after;
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            std::cout << "Progress: " << (i * 100) / total_tests << "% (" << i << "/" << total_tests
+                      << ") | Found " << mismatches << " mismatches" << std::endl;
+        }
+    });
+
+    std::cout << "\nSaving final results..." << std::endl;
+    if (!write_results_json(results_file, results) || !write_mismatch_log(log_file, target.name(), results)) {
+        std::cout << "Error: Cannot write " << results_file << " or " << log_file << std::endl;
+        return 1;
+    }
+    if (!opts.trace.empty() && !write_trace_log(opts.trace, reference.name(), target.name(), results)) {
+        std::cout << "Error: Cannot write " << opts.trace << std::endl;
+        return 1;
+    }
+
+    size_t counts[5] = {};
+    const char* statuses[5] = { "match", "mismatch", "error", "skipped_kitty_empty", "skipped_target_fallback" };
+    for (const TestResult& r : results) {
+        for (int s = 0; s < 5; ++s) {
+            if (strcmp(r.status, statuses[s]) == 0) counts[s]++;
+        }
+    }
+
+    std::cout << "\n--- Test Summary ---" << std::endl;
+    std::cout << "Target: " << target.name() << std::endl;
+    std::cout << "Total combinations run: " << results.size() << " / " << total_tests << std::endl;
+    std::cout << "  Matches: " << counts[0] << std::endl;
+    std::cout << "  Mismatches: " << counts[1] << std::endl;
+    std::cout << "  Skipped: " << counts[3] + counts[4] << std::endl;
+    std::cout << "    Kitty return nothing: " << counts[3] << std::endl;
+    std::cout << "    Target falled back to legacy generation: " << counts[4] << std::endl;
+    std::cout << "  Errors: " << counts[2] << std::endl;
+    std::cout << "\n--- Output Files ---" << std::endl;
+    if (counts[1] || counts[2]) {
+        std::cout << "Mismatch details: '" << log_file << "'" << std::endl;
+    }
+    std::cout << "Raw results: '" << results_file << "'" << std::endl;
+    if (!opts.trace.empty()) {
+        std::cout << "Traces of mismatches and errors: '" << opts.trace << "'" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "encoder_plugin.h"
+#include <dlfcn.h>
+#include "../common/kt_trace.h"
+
+EncoderPlugin::~EncoderPlugin() {
+    if (m_handle) dlclose(m_handle);
+}
+
+bool EncoderPlugin::load(const std::string& path, std::string& err) {
+    m_handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!m_handle) {
+        err = std::string("Cannot load plugin: ") + dlerror();
+        return false;
+    }
+
+    auto abi_version = (int (*)(void))dlsym(m_handle, "kt_abi_version");
+    auto name = (const char* (*)(void))dlsym(m_handle, "kt_name");
+    m_encode = (kt_encode_fn)dlsym(m_handle, "kt_encode");
+    if (!abi_version || !name || !m_encode) {
+        err = "Plugin " + path + " does not export kt_abi_version, kt_name and kt_encode";
+        return false;
+    }
+    if (abi_version() != KT_PLUGIN_ABI_VERSION) {
+        err = "Plugin " + path + " has ABI version " + std::to_string(abi_version()) +
+              ", expected " + std::to_string(KT_PLUGIN_ABI_VERSION);
+        return false;
+    }
+
+    // Optional
+    m_trace_dump = (size_t (*)(char*, size_t))dlsym(m_handle, "kt_trace_dump");
+
+    m_name = name();
+    return true;
+}
+
+static bool is_py_space(char c) {
+    // Whitespace as stripped by Python's bytes.strip()
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\x0b' || c == '\x0c';
+}
+
+std::string EncoderPlugin::encode(const kt_key_event& ev) const {
+    char out[KT_OUTPUT_MAX + 1];
+    int len = m_encode(&ev, out, KT_OUTPUT_MAX);
+    if (len < 0) {
+        out[KT_OUTPUT_MAX] = '\0';
+        return std::string("[ERROR: ") + out + "]";
+    }
+
+    size_t begin = 0, end = (size_t)len;
+    while (begin < end && is_py_space(out[begin])) ++begin;
+    while (end > begin && is_py_space(out[end - 1])) --end;
+    return std::string(out + begin, end - begin);
+}
+
+std::string EncoderPlugin::trace(const kt_key_event& ev) const {
+    if (!m_trace_dump) return std::string();
+    char out[KT_OUTPUT_MAX];
+    char records[KT_TRACE_TEXT_MAX];
+    m_trace_dump(nullptr, 0);
+    m_encode(&ev, out, sizeof(out));
+    return std::string(records, m_trace_dump(records, sizeof(records)));
+}
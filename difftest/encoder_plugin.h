@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include "../common/kt_plugin.h"
+
+// An encoder plugin (build/lib/libkt_*.so) opened with dlopen().
+//
+// Plugins are opened with RTLD_LOCAL, so the mocks and extracted code of
+// different encoders never resolve against each other.
+class EncoderPlugin {
+public:
+    EncoderPlugin() = default;
+    ~EncoderPlugin();
+    EncoderPlugin(const EncoderPlugin&) = delete;
+    EncoderPlugin& operator=(const EncoderPlugin&) = delete;
+
+    // Opens `path` and checks its ABI version. Returns false with a message
+    // in `err` on failure.
+    bool load(const std::string& path, std::string& err);
+
+    // Encodes `ev` and returns what run_tests.py would have read from the
+    // tester: the output with surrounding whitespace stripped, or
+    // "[ERROR: <message>]".
+    std::string encode(const kt_key_event& ev) const;
+
+    // Calls the plugin's kt_encode() as is, without the post-processing of
+    // encode(). For benchmarks.
+    int encode_raw(const kt_key_event& ev, char* out, size_t out_size) const { return m_encode(&ev, out, out_size); }
+
+    // Encodes `ev` again and returns the trace records it left (see
+    // common/kt_trace.h). Empty unless the plugin was built with TRACE=1;
+    // the Alacritty plugin does not export kt_trace_dump at all.
+    std::string trace(const kt_key_event& ev) const;
+
+    const std::string& name() const { return m_name; }
+
+private:
+    void* m_handle = nullptr;
+    kt_encode_fn m_encode = nullptr;
+    size_t (*m_trace_dump)(char*, size_t) = nullptr;
+    std::string m_name;
+};
@@ -0,0 +1,57 @@
+#include "executor.h"
+#include <algorithm>
+#include <thread>
+
+Executor::Executor(unsigned jobs, size_t chunk_size)
+    : m_jobs(std::max(1u, jobs)), m_chunk_size(std::max<size_t>(1, chunk_size)), m_workers(m_jobs) {
+}
+
+bool Executor::pop_own(Worker& worker, size_t& chunk) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.chunks.empty()) return false;
+    chunk = worker.chunks.front();
+    worker.chunks.pop_front();
+    return true;
+}
+
+bool Executor::steal(unsigned thief, size_t& chunk) {
+    for (unsigned n = 1; n < m_jobs; ++n) {
+        Worker& victim = m_workers[(thief + n) % m_jobs];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Executor::work(unsigned id, size_t count, const ChunkFn& fn) {
+    size_t chunk;
+    while (pop_own(m_workers[id], chunk) || steal(id, chunk)) {
+        size_t begin = chunk * m_chunk_size;
+        fn(begin, std::min(begin + m_chunk_size, count));
+    }
+}
+
+void Executor::run(size_t count, const ChunkFn& fn) {
+    size_t chunks = (count + m_chunk_size - 1) / m_chunk_size;
+    for (unsigned id = 0; id < m_jobs; ++id) {
+        // Contiguous runs keep neighbouring keys on the same worker
+        for (size_t c = chunks * id / m_jobs; c < chunks * (id + 1) / m_jobs; ++c) {
+            m_workers[id].chunks.push_back(c);
+        }
+    }
+
+    if (m_jobs == 1) {
+        work(0, count, fn);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned id = 0; id < m_jobs; ++id) {
+        threads.emplace_back(&Executor::work, this, id, count, std::cref(fn));
+    }
+    for (std::thread& t : threads) t.join();
+}
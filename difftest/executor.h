@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs a function over the index range [0, count) on a work-stealing pool.
+//
+// The range is cut into chunks of `chunk_size` indices. Every worker starts
+// with a contiguous run of chunks in its own deque and takes them from the
+// front; a worker that runs dry steals from the back of another worker's
+// deque. Chunks therefore complete in no particular order: callers store
+// results by index and merge them once run() returns.
+class Executor {
+public:
+    using ChunkFn = std::function<void(size_t begin, size_t end)>;
+
+    Executor(unsigned jobs, size_t chunk_size);
+
+    // Blocks until every chunk has been processed. With a single job the
+    // chunks run in order on the calling thread.
+    void run(size_t count, const ChunkFn& fn);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<size_t> chunks; // Chunk numbers
+    };
+
+    bool pop_own(Worker& worker, size_t& chunk);
+    bool steal(unsigned thief, size_t& chunk);
+    void work(unsigned id, size_t count, const ChunkFn& fn);
+
+    unsigned m_jobs;
+    size_t m_chunk_size;
+    std::vector<Worker> m_workers;
+};
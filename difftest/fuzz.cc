@@ -0,0 +1,311 @@
+// Differential fuzz target: decodes arbitrary bytes into a key event, runs it
+// through the reference and a target plugin in-process and reports every new
+// kind of disagreement together with tester command lines reproducing it.
+//
+// Unlike the run_tests.py matrix, the events cover Unicode keys with shifted
+// variants, --super, release and repeat actions, --cursor-key-mode and
+// --base-key.
+//
+// Built two ways:
+//   make fuzz     clang and libFuzzer (LLVMFuzzerTestOneInput), guided by the
+//                 coverage of the plugins instrumented under build/fuzz/lib
+//   difffuzz      plain driver built by 'make': random inputs, or replays the
+//                 input files given on the command line
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "encoder_plugin.h"
+#include "report.h"
+#include "test_matrix.h"
+
+#ifndef KT_PLUGIN_DIR
+#define KT_PLUGIN_DIR "./build/lib"
+#endif
+
+static const char* TESTER_DIR = "./build/bin";
+static const size_t MAX_REPORTS = 1000;
+
+struct FuzzOptions {
+    std::string reference = "kitty";
+    std::string target = "vte";
+    std::string report = "fuzz_mismatches.log";
+};
+
+static std::string plugin_path(const std::string& name) {
+    if (name.find('/') != std::string::npos) return name;
+    return std::string(KT_PLUGIN_DIR) + "/libkt_" + name + ".so";
+}
+
+// Consumes the fuzz input byte by byte; an exhausted input reads as zeros
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+    unsigned byte() { return m_pos < m_size ? m_data[m_pos++] : 0; }
+
+    // A printable codepoint (no C0/C1 controls, DEL or surrogates)
+    unsigned codepoint() {
+        unsigned cp = (byte() << 16 | byte() << 8 | byte()) % 0x10FFFF;
+        if (cp < 0x20 || (cp >= 0x7F && cp < 0xA0)) cp += 0xA0;
+        if (cp >= 0xD800 && cp < 0xE000) cp += 0x800;
+        return cp;
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+// A key event with the storage for its strings
+struct FuzzEvent {
+    std::string key;
+    std::string shifted_key;
+    std::string base_key;
+    kt_key_event ev = {};
+
+    explicit FuzzEvent(ByteReader& in) {
+        unsigned selector = in.byte();
+        if (selector & 0x80) {
+            key = unicode_name(in.codepoint());
+            if (selector & 0x40) shifted_key = unicode_name(in.codepoint());
+            // Some physical key, for encoders that need one
+            ev.keycode = TEST_KEYS[in.byte() % TEST_KEY_COUNT].keycode;
+        } else {
+            const TestKey& k = TEST_KEYS[selector % TEST_KEY_COUNT];
+            key = k.name;
+            ev.keycode = k.keycode;
+            if (k.base_key) base_key = k.base_key;
+        }
+
+        ev.mods = in.byte() & (KT_MOD_SHIFT | KT_MOD_CTRL | KT_MOD_ALT | KT_MOD_SUPER | KT_MOD_CAPS | KT_MOD_NUM);
+        ev.action = in.byte() % 3;
+        ev.kitty_flags = in.byte() % TEST_KITTY_FLAGS;
+        unsigned extra = in.byte();
+        ev.cursor_key_mode = extra & 1;
+        if (extra & 2) base_key = std::string(1, (char)('a' + in.byte() % 26));
+
+        ev.key = key.c_str();
+        ev.shifted_key = shifted_key.empty() ? nullptr : shifted_key.c_str();
+        ev.base_key = base_key.empty() ? nullptr : base_key.c_str();
+    }
+
+    static std::string unicode_name(unsigned cp) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "U+%04X", cp);
+        return buf;
+    }
+
+    // Tester command line reproducing the event
+    std::string command_line(const std::string& plugin_name) const {
+        std::string cmd = std::string(TESTER_DIR) + "/" + plugin_name + "_tester --key " + shell_quote(key);
+        if (!shifted_key.empty()) cmd += " --shifted-key " + shifted_key;
+        if (!base_key.empty()) cmd += " --base-key " + base_key;
+        if (plugin_name == "vte") cmd += " --keycode " + std::to_string(ev.keycode);
+        static const std::pair<unsigned, const char*> mod_args[] = {
+            { KT_MOD_SHIFT, "--shift" }, { KT_MOD_CTRL, "--ctrl" }, { KT_MOD_ALT, "--alt" },
+            { KT_MOD_SUPER, "--super" }, { KT_MOD_CAPS, "--caps" }, { KT_MOD_NUM, "--num" },
+        };
+        for (const auto& m : mod_args) {
+            if (ev.mods & m.first) cmd += std::string(" ") + m.second;
+        }
+        cmd += " --kitty-flags " + std::to_string(ev.kitty_flags);
+        if (ev.action == KT_ACTION_RELEASE) cmd += " --action release";
+        else if (ev.action == KT_ACTION_REPEAT) cmd += " --action repeat";
+        if (ev.cursor_key_mode) cmd += " --cursor-key-mode";
+        return cmd;
+    }
+
+    static std::string shell_quote(const std::string& s) {
+        std::string quoted = "'";
+        for (char c : s) {
+            if (c == '\'') quoted += "'\\''";
+            else quoted += c;
+        }
+        return quoted + "'";
+    }
+};
+
+// Outputs with every digit run replaced by '#'. Disagreements of the same
+// shape differ only in key codes or modifier values and are reported once.
+static std::string output_shape(const std::string& out) {
+    std::string shape;
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (out[i] >= '0' && out[i] <= '9') {
+            shape += '#';
+            while (i + 1 < out.size() && out[i + 1] >= '0' && out[i + 1] <= '9') ++i;
+        } else {
+            shape += out[i];
+        }
+    }
+    return shape;
+}
+
+// The encoder plugins report failures as "[ERROR: <message>]"
+static bool is_error(const std::string& out) {
+    return out.rfind("[ERROR: ", 0) == 0;
+}
+
+class DiffFuzzer {
+public:
+    bool init(const FuzzOptions& opts) {
+        std::string err;
+        if (!m_reference.load(plugin_path(opts.reference), err) || !m_target.load(plugin_path(opts.target), err)) {
+            std::cerr << "Error: " << err << ". Run 'make' first." << std::endl;
+            return false;
+        }
+        m_report.open(opts.report, std::ios::binary | std::ios::app);
+        if (!m_report) {
+            std::cerr << "Error: Cannot open " << opts.report << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Returns the status of the event encoded from `data`
+    const char* run(const uint8_t* data, size_t size, bool verbose = false) {
+        ByteReader in(data, size);
+        FuzzEvent event(in);
+        std::string ref_out = m_reference.encode(event.ev);
+        std::string target_out = m_target.encode(event.ev);
+        bool ref_error = is_error(ref_out);
+        bool target_error = is_error(target_out);
+        // Identical raw outputs match unless both are errors or empty, which
+        // spares the formatting in classify() on the common path
+        const char* status = ref_out == target_out && !ref_error && !ref_out.empty() ? "match" : classify(ref_out, target_out);
+        m_execs++;
+
+        if (verbose) {
+            std::cout << status << "\n  " << m_reference.name() << ": " << to_utf8(format_raw_output(ref_out))
+                      << "\n  " << m_target.name() << ": " << to_utf8(format_raw_output(target_out))
+                      << "\n  " << event.command_line(m_reference.name())
+                      << "\n  " << event.command_line(m_target.name()) << std::endl;
+        }
+        // An error on one side only is a disagreement as well: one encoder
+        // rejects an event the other one encodes
+        if (strcmp(status, "mismatch") == 0 || ref_error != target_error) {
+            m_disagreements++;
+            if (m_reported.size() < MAX_REPORTS && m_reported.emplace(output_shape(ref_out), output_shape(target_out)).second) {
+                m_report << m_reference.name() << ": " << to_utf8(format_raw_output(ref_out)) << " | "
+                         << m_target.name() << ": " << to_utf8(format_raw_output(target_out)) << "\n"
+                         << "  " << event.command_line(m_reference.name()) << "\n"
+                         << "  " << event.command_line(m_target.name()) << "\n";
+                m_report.flush();
+            }
+        }
+        return status;
+    }
+
+    size_t execs() const { return m_execs; }
+    size_t disagreements() const { return m_disagreements; }
+    size_t reported() const { return m_reported.size(); }
+
+private:
+    EncoderPlugin m_reference;
+    EncoderPlugin m_target;
+    std::ofstream m_report;
+    std::set<std::pair<std::string, std::string>> m_reported;
+    size_t m_execs = 0;
+    size_t m_disagreements = 0;
+};
+
+static DiffFuzzer fuzzer;
+
+// The encoders report setup failures on stderr
+static void silence_stderr() {
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+        dup2(devnull, STDERR_FILENO);
+        close(devnull);
+    }
+}
+
+#ifdef KT_LIBFUZZER
+
+// libFuzzer passes flags starting with "--" through to the target:
+// --reference=<name|path.so> --target=<name|path.so> --report=<file>
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    FuzzOptions opts;
+    for (int i = 1; i < *argc; ++i) {
+        std::string arg = (*argv)[i];
+        if (arg.rfind("--reference=", 0) == 0) opts.reference = arg.substr(12);
+        else if (arg.rfind("--target=", 0) == 0) opts.target = arg.substr(9);
+        else if (arg.rfind("--report=", 0) == 0) opts.report = arg.substr(9);
+    }
+    if (!fuzzer.init(opts)) exit(1);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzzer.run(data, size);
+    return 0;
+}
+
+#else
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--target <name|path.so>] [--reference <name|path.so>] [--report <file>] [--runs N] [--seed N] [--debug]" << std::endl;
+    std::cerr << "       " << prog << " [--target ...] [--reference ...] <input file>...   (replay)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    FuzzOptions opts;
+    size_t runs = 1000000;
+    unsigned seed = 1;
+    bool debug = false;
+    std::vector<std::string> inputs;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--target" && i + 1 < argc) opts.target = argv[++i];
+            else if (arg == "--reference" && i + 1 < argc) opts.reference = argv[++i];
+            else if (arg == "--report" && i + 1 < argc) opts.report = argv[++i];
+            else if (arg == "--runs" && i + 1 < argc) runs = std::stoul(argv[++i]);
+            else if (arg == "--seed" && i + 1 < argc) seed = std::stoul(argv[++i]);
+            else if (arg == "--debug") debug = true;
+            else if (arg[0] != '-') inputs.push_back(arg);
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!fuzzer.init(opts)) return 1;
+    if (!debug) silence_stderr();
+
+    if (!inputs.empty()) {
+        for (const std::string& path : inputs) {
+            std::ifstream f(path, std::ios::binary);
+            std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+            std::cout << path << ": ";
+            fuzzer.run(data.data(), data.size(), true);
+        }
+        return 0;
+    }
+
+    std::mt19937 rng(seed);
+    uint8_t data[16];
+    for (size_t n = 0; n < runs; ++n) {
+        for (uint8_t& b : data) b = (uint8_t)rng();
+        fuzzer.run(data, sizeof(data));
+    }
+    std::cout << fuzzer.execs() << " events, " << fuzzer.disagreements() << " disagreements, "
+              << fuzzer.reported() << " distinct ones reported to " << opts.report << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "golden.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+GoldenWriter::GoldenWriter(const std::string& label) {
+    intern(label);
+}
+
+uint32_t GoldenWriter::intern(const std::string& str) {
+    auto it = m_ids.find(str);
+    if (it != m_ids.end()) return it->second;
+
+    uint32_t id = m_strings.size();
+    m_strings.push_back({ (uint32_t)m_data.size(), (uint32_t)str.size() });
+    m_data += str;
+    m_ids.emplace(str, id);
+    return id;
+}
+
+void GoldenWriter::add(const std::string& input, uint32_t flags, const std::string& output) {
+    uint32_t input_id = intern(input);
+    m_records.push_back({ input_id, flags, intern(output) });
+}
+
+bool GoldenWriter::write(const std::string& path) const {
+    GoldenHeader header = {};
+    memcpy(header.magic, GOLDEN_MAGIC, sizeof(header.magic));
+    header.version = GOLDEN_VERSION;
+    header.record_count = m_records.size();
+    header.string_count = m_strings.size();
+    header.label = 0;
+    header.records_offset = sizeof(GoldenHeader);
+    header.strings_offset = header.records_offset + m_records.size() * sizeof(GoldenRecord);
+    header.data_offset = header.strings_offset + m_strings.size() * sizeof(GoldenString);
+    header.data_size = m_data.size();
+
+    // Written under a temporary name, so readers never map a partial file
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)m_records.data(), m_records.size() * sizeof(GoldenRecord));
+        out.write((const char*)m_strings.data(), m_strings.size() * sizeof(GoldenString));
+        out.write(m_data.data(), m_data.size());
+        if (!out) {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+GoldenFile::~GoldenFile() {
+    if (m_map) munmap(m_map, m_map_size);
+}
+
+bool GoldenFile::open(const std::string& path, std::string& err) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = "Cannot open " + path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(GoldenHeader)) {
+        close(fd);
+        err = path + " is not a golden file";
+        return false;
+    }
+    m_map_size = st.st_size;
+    m_map = mmap(nullptr, m_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        err = "Cannot map " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    const char* base = (const char*)m_map;
+    m_header = (const GoldenHeader*)base;
+    if (memcmp(m_header->magic, GOLDEN_MAGIC, sizeof(GOLDEN_MAGIC)) != 0) {
+        err = path + " is not a golden file";
+        return false;
+    }
+    if (m_header->version != GOLDEN_VERSION) {
+        err = path + " has golden format version " + std::to_string(m_header->version) +
+              ", expected " + std::to_string(GOLDEN_VERSION);
+        return false;
+    }
+    if (m_header->records_offset + (uint64_t)m_header->record_count * sizeof(GoldenRecord) > m_map_size ||
+        m_header->strings_offset + (uint64_t)m_header->string_count * sizeof(GoldenString) > m_map_size ||
+        m_header->data_offset + m_header->data_size > m_map_size ||
+        m_header->label >= m_header->string_count) {
+        err = path + " is truncated";
+        return false;
+    }
+
+    m_records = (const GoldenRecord*)(base + m_header->records_offset);
+    m_strings = (const GoldenString*)(base + m_header->strings_offset);
+    m_data = base + m_header->data_offset;
+
+    // Validate every id once, so that lookups need no checks
+    for (uint32_t i = 0; i < m_header->string_count; ++i) {
+        if ((uint64_t)m_strings[i].offset + m_strings[i].length > m_header->data_size) {
+            err = path + " has a corrupt dictionary";
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < m_header->record_count; ++i) {
+        if (m_records[i].input >= m_header->string_count || m_records[i].output >= m_header->string_count) {
+            err = path + " has a corrupt record";
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view GoldenFile::str(uint32_t id) const {
+    return std::string_view(m_data + m_strings[id].offset, m_strings[id].length);
+}
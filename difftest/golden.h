@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Binary golden rules file: the kitty reference output of every combination.
+//
+// Layout (native byte order):
+//   GoldenHeader
+//   GoldenRecord[record_count]     indexed by combination number
+//   GoldenString[string_count]     dictionary index
+//   string data                    dictionary contents, not NUL-terminated
+//
+// Inputs (tester arguments, without the flags) and outputs (raw bytes, with
+// surrounding whitespace stripped like run_tests.py does) are interned in
+// the dictionary, since few distinct values repeat across the matrix. String
+// 0 is a free-form label, e.g. the kitty revision.
+
+static const char GOLDEN_MAGIC[8] = { 'K', 'T', 'G', 'O', 'L', 'D', '\0', '\0' };
+static const uint32_t GOLDEN_VERSION = 1;
+
+struct GoldenHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_count;
+    uint32_t string_count;
+    uint32_t label;              // String id
+    uint64_t records_offset;
+    uint64_t strings_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+};
+
+struct GoldenRecord {
+    uint32_t input;              // String id, e.g. "--key a --ctrl"
+    uint32_t flags;              // kitty keyboard flags
+    uint32_t output;             // String id
+};
+
+struct GoldenString {
+    uint32_t offset;             // Relative to data_offset
+    uint32_t length;
+};
+
+class GoldenWriter {
+public:
+    explicit GoldenWriter(const std::string& label);
+
+    void add(const std::string& input, uint32_t flags, const std::string& output);
+
+    bool write(const std::string& path) const;
+
+private:
+    uint32_t intern(const std::string& str);
+
+    std::vector<GoldenRecord> m_records;
+    std::vector<GoldenString> m_strings;
+    std::string m_data;
+    std::unordered_map<std::string, uint32_t> m_ids;
+};
+
+// Read-only view of a golden file mapped with mmap(). Lookups are O(1) and
+// return views into the mapping.
+class GoldenFile {
+public:
+    GoldenFile() = default;
+    ~GoldenFile();
+    GoldenFile(const GoldenFile&) = delete;
+    GoldenFile& operator=(const GoldenFile&) = delete;
+
+    // Returns false with a message in `err` if the file cannot be mapped or
+    // is not a valid golden file.
+    bool open(const std::string& path, std::string& err);
+
+    uint32_t size() const { return m_header->record_count; }
+    const GoldenRecord& record(uint32_t index) const { return m_records[index]; }
+    std::string_view str(uint32_t id) const;
+    std::string_view label() const { return str(m_header->label); }
+
+private:
+    void* m_map = nullptr;
+    size_t m_map_size = 0;
+    const GoldenHeader* m_header = nullptr;
+    const GoldenRecord* m_records = nullptr;
+    const GoldenString* m_strings = nullptr;
+    const char* m_data = nullptr;
+};
@@ -0,0 +1,94 @@
+// Compares two binary golden files, e.g. before and after bumping the kitty
+// revision in source/get_samples.sh, and lists every combination whose
+// reference output changed.
+//
+// Exit status: 0 if the files agree, 1 if they differ, 2 on errors.
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "golden.h"
+#include "report.h"
+
+static std::string fmt(std::string_view output) {
+    return to_utf8(format_raw_output(std::string(output)));
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <old.golden> <new.golden> [--limit N]" << std::endl;
+        return 2;
+    }
+    size_t limit = 0;
+    for (int i = 3; i < argc; ++i) {
+        if (std::string(argv[i]) == "--limit" && i + 1 < argc) limit = std::stoul(argv[++i]);
+    }
+
+    GoldenFile old_file, new_file;
+    std::string err;
+    if (!old_file.open(argv[1], err) || !new_file.open(argv[2], err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 2;
+    }
+
+    size_t changed = 0, added = 0, removed = 0, printed = 0;
+    auto report = [&](char tag, const GoldenRecord& rec, const GoldenFile& file, const std::string& outputs) {
+        if (limit && printed >= limit) return;
+        printed++;
+        std::cout << tag << " " << file.str(rec.input) << " | " << rec.flags << " | " << outputs << "\n";
+    };
+
+    // Files generated from the same matrix line up record by record
+    bool aligned = old_file.size() == new_file.size();
+    for (uint32_t i = 0; aligned && i < old_file.size(); ++i) {
+        const GoldenRecord& a = old_file.record(i);
+        const GoldenRecord& b = new_file.record(i);
+        aligned = a.flags == b.flags && old_file.str(a.input) == new_file.str(b.input);
+    }
+
+    if (aligned) {
+        for (uint32_t i = 0; i < old_file.size(); ++i) {
+            const GoldenRecord& a = old_file.record(i);
+            const GoldenRecord& b = new_file.record(i);
+            if (old_file.str(a.output) != new_file.str(b.output)) {
+                changed++;
+                report('~', a, old_file, fmt(old_file.str(a.output)) + " -> " + fmt(new_file.str(b.output)));
+            }
+        }
+    } else {
+        // The matrix itself changed: match combinations by input and flags
+        std::unordered_map<std::string, uint32_t> new_index;
+        std::vector<bool> matched(new_file.size());
+        for (uint32_t i = 0; i < new_file.size(); ++i) {
+            const GoldenRecord& b = new_file.record(i);
+            new_index.emplace(std::string(new_file.str(b.input)) + "|" + std::to_string(b.flags), i);
+        }
+        for (uint32_t i = 0; i < old_file.size(); ++i) {
+            const GoldenRecord& a = old_file.record(i);
+            auto it = new_index.find(std::string(old_file.str(a.input)) + "|" + std::to_string(a.flags));
+            if (it == new_index.end()) {
+                removed++;
+                report('-', a, old_file, fmt(old_file.str(a.output)));
+                continue;
+            }
+            matched[it->second] = true;
+            const GoldenRecord& b = new_file.record(it->second);
+            if (old_file.str(a.output) != new_file.str(b.output)) {
+                changed++;
+                report('~', a, old_file, fmt(old_file.str(a.output)) + " -> " + fmt(new_file.str(b.output)));
+            }
+        }
+        for (uint32_t i = 0; i < new_file.size(); ++i) {
+            if (matched[i]) continue;
+            added++;
+            report('+', new_file.record(i), new_file, fmt(new_file.str(new_file.record(i).output)));
+        }
+    }
+
+    std::cout << "\nOld: " << argv[1] << " (" << old_file.label() << ", " << old_file.size() << " combinations)" << std::endl;
+    std::cout << "New: " << argv[2] << " (" << new_file.label() << ", " << new_file.size() << " combinations)" << std::endl;
+    std::cout << "Changed: " << changed << ", Added: " << added << ", Removed: " << removed << std::endl;
+    return (changed || added || removed) ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+#include "report.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+// Decodes UTF-8 the way Python's bytes.decode('utf-8', errors='replace')
+// does: each maximal invalid subsequence becomes a single U+FFFD.
+static std::u32string decode_utf8(const std::string& bytes) {
+    std::u32string text;
+    size_t i = 0, n = bytes.size();
+    while (i < n) {
+        unsigned char b = bytes[i];
+        if (b < 0x80) {
+            text += (char32_t)b;
+            ++i;
+            continue;
+        }
+
+        int need;
+        unsigned char lo = 0x80, hi = 0xBF;
+        char32_t cp;
+        if (b >= 0xC2 && b <= 0xDF) { need = 1; cp = b & 0x1F; }
+        else if (b == 0xE0) { need = 2; cp = b & 0x0F; lo = 0xA0; }
+        else if (b == 0xED) { need = 2; cp = b & 0x0F; hi = 0x9F; }
+        else if (b >= 0xE1 && b <= 0xEF) { need = 2; cp = b & 0x0F; }
+        else if (b == 0xF0) { need = 3; cp = b & 0x07; lo = 0x90; }
+        else if (b == 0xF4) { need = 3; cp = b & 0x07; hi = 0x8F; }
+        else if (b >= 0xF1 && b <= 0xF3) { need = 3; cp = b & 0x07; }
+        else {
+            text += U'\uFFFD';
+            ++i;
+            continue;
+        }
+
+        size_t j = i + 1;
+        for (int k = 0; k < need; ++k, ++j) {
+            if (j >= n) break;
+            unsigned char c = bytes[j];
+            if (c < lo || c > hi) break;
+            cp = (cp << 6) | (c & 0x3F);
+            lo = 0x80;
+            hi = 0xBF;
+        }
+        if (j - i == (size_t)need + 1) {
+            text += cp;
+        } else {
+            text += U'\uFFFD';
+        }
+        i = j;
+    }
+    return text;
+}
+
+std::u32string format_raw_output(const std::string& raw) {
+    if (raw.empty()) return U"[EMPTY]";
+
+    std::u32string text;
+    for (char32_t c : decode_utf8(raw)) {
+        switch (c) {
+            case 0x1b: text += U"ESC"; break;
+            case 0x00: text += U"\\0"; break;
+            case '\r': text += U"\\r"; break;
+            case '\t': text += U"\\t"; break;
+            case '\b': text += U"\\b"; break;
+            default: text += c; break;
+        }
+    }
+    return text;
+}
+
+std::string to_utf8(const std::u32string& text) {
+    std::string out;
+    for (char32_t c : text) {
+        if (c < 0x80) {
+            out += (char)c;
+        } else if (c < 0x800) {
+            out += (char)(0xC0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out += (char)(0xE0 | (c >> 12));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        } else {
+            out += (char)(0xF0 | (c >> 18));
+            out += (char)(0x80 | ((c >> 12) & 0x3F));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+const char* classify(const std::string& kitty_out, const std::string& target_out) {
+    std::u32string kitty_fmt = format_raw_output(kitty_out);
+    std::u32string target_fmt = format_raw_output(target_out);
+
+    if (kitty_fmt.find(U"[ERROR:") != std::u32string::npos || target_fmt.find(U"[ERROR:") != std::u32string::npos) {
+        return "error";
+    }
+    if (kitty_fmt == U"[EMPTY]") return "skipped_kitty_empty";
+    // Only VTE emits [LEGACY_FALLBACK], every target may emit [EMPTY]
+    if (target_fmt == U"[LEGACY_FALLBACK]" || target_fmt == U"[EMPTY]") return "skipped_target_fallback";
+    if (kitty_fmt == target_fmt) return "match";
+    return "mismatch";
+}
+
+// JSON string literal with json.dumps()' ensure_ascii escaping
+static std::string json_string(const std::u32string& text) {
+    std::string out = "\"";
+    char buf[16];
+    for (char32_t c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (c >= 0x20 && c <= 0x7e) {
+                    out += (char)c;
+                } else if (c < 0x10000) {
+                    snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+                    out += buf;
+                } else {
+                    char32_t v = c - 0x10000;
+                    snprintf(buf, sizeof(buf), "\\u%04x\\u%04x", (unsigned)(0xD800 | (v >> 10)), (unsigned)(0xDC00 | (v & 0x3FF)));
+                    out += buf;
+                }
+                break;
+        }
+    }
+    return out + "\"";
+}
+
+bool write_results_json(const std::string& path, const std::vector<TestResult>& results) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+
+    if (results.empty()) {
+        f << "[]";
+        return bool(f);
+    }
+
+    f << "[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const TestResult& r = results[i];
+        f << (i ? ",\n  {\n" : "\n  {\n");
+        f << "    \"combo\": " << json_string(decode_utf8(r.combo)) << ",\n";
+        f << "    \"status\": \"" << r.status << "\",\n";
+        f << "    \"kitty_out_fmt\": " << json_string(format_raw_output(r.kitty_out)) << ",\n";
+        f << "    \"target_out_fmt\": " << json_string(format_raw_output(r.target_out)) << "\n";
+        f << "  }";
+    }
+    f << "\n]";
+    return bool(f);
+}
+
+// Python's str.ljust(): pads to `width` code points
+static std::string ljust(const std::u32string& text, size_t width) {
+    std::string out = to_utf8(text);
+    if (text.size() < width) out.append(width - text.size(), ' ');
+    return out;
+}
+
+bool write_mismatch_log(const std::string& path, const std::string& target_name, const std::vector<TestResult>& results) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+
+    std::vector<const TestResult*> mismatches;
+    for (const TestResult& r : results) {
+        if (std::string(r.status) == "mismatch") mismatches.push_back(&r);
+    }
+
+    f << "Target: " << target_name << "\n";
+    f << "Found " << mismatches.size() << " mismatches.\n\n";
+
+    size_t max_combo_len = 0;
+    size_t max_kitty_len = 0;
+    for (const TestResult* r : mismatches) {
+        max_combo_len = std::max(max_combo_len, decode_utf8(r->combo).size());
+        max_kitty_len = std::max(max_kitty_len, format_raw_output(r->kitty_out).size());
+    }
+
+    for (const TestResult* r : mismatches) {
+        f << ljust(decode_utf8(r->combo), max_combo_len)
+          << " -> kitty: " << ljust(format_raw_output(r->kitty_out), max_kitty_len)
+          << " | " << target_name << ": " << to_utf8(format_raw_output(r->target_out)) << "\n";
+    }
+    return bool(f);
+}
+
+static void write_trace_records(std::ofstream& f, const std::string& name, const std::string& records) {
+    f << "  [" << name << "]\n";
+    if (records.empty()) {
+        f << "    (no trace records)\n";
+        return;
+    }
+    size_t begin = 0;
+    while (begin < records.size()) {
+        size_t end = records.find('\n', begin);
+        if (end == std::string::npos) end = records.size();
+        f << "    " << records.substr(begin, end - begin) << "\n";
+        begin = end + 1;
+    }
+}
+
+bool write_trace_log(const std::string& path, const std::string& reference_name, const std::string& target_name,
+                     const std::vector<TestResult>& results) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+
+    for (const TestResult& r : results) {
+        std::string status = r.status;
+        if (status != "mismatch" && status != "error") continue;
+        f << r.combo << " (" << status << ")\n";
+        write_trace_records(f, reference_name, r.kitty_trace);
+        write_trace_records(f, target_name, r.target_trace);
+    }
+    return bool(f);
+}
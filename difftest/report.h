@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Writers for test_results.json and mismatches.log. The output is byte for
+// byte what run_tests.py writes for the same results, so that either driver
+// can produce them.
+
+struct TestResult {
+    std::string combo;       // "Key: shift+a, Flags: 3"
+    const char* status;      // "match", "mismatch", "error", "skipped_..."
+    std::string kitty_out;   // Raw reference output
+    std::string target_out;  // Raw target output
+    std::string kitty_trace; // Trace records, only collected with --trace
+    std::string target_trace;
+};
+
+// run_tests.py's format_raw_output(): decodes `raw` as UTF-8 with invalid
+// sequences replaced by U+FFFD, then makes control characters visible.
+std::u32string format_raw_output(const std::string& raw);
+
+std::string to_utf8(const std::u32string& text);
+
+// The status run_tests.py assigns to a pair of raw outputs: "match",
+// "mismatch", "error", "skipped_kitty_empty" or "skipped_target_fallback"
+const char* classify(const std::string& kitty_out, const std::string& target_out);
+
+// Same as json.dump(results, f, indent=2) with ensure_ascii enabled
+bool write_results_json(const std::string& path, const std::vector<TestResult>& results);
+
+bool write_mismatch_log(const std::string& path, const std::string& target_name, const std::vector<TestResult>& results);
+
+// Trace records of the mismatches and errors, in the format of run_tests.py's
+// TraceLog: the combination, then every side's records indented under it
+bool write_trace_log(const std::string& path, const std::string& reference_name, const std::string& target_name,
+                     const std::vector<TestResult>& results);
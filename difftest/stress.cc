@@ -0,0 +1,61 @@
+// Reentrancy stress test for an encoder plugin: encodes the combination
+// matrix once on the main thread, then has N threads encode it concurrently
+// and checks every output against the serial one. Built with
+// -fsanitize=thread by 'make stress'.
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "encoder_plugin.h"
+#include "test_matrix.h"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <plugin.so> [--threads N] [--rounds N]" << std::endl;
+        return 1;
+    }
+
+    unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+    unsigned rounds = 1;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) threads = std::stoul(argv[++i]);
+        else if (arg == "--rounds" && i + 1 < argc) rounds = std::stoul(argv[++i]);
+    }
+
+    EncoderPlugin plugin;
+    std::string err;
+    if (!plugin.load(argv[1], err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> expected(TEST_COMBINATION_COUNT);
+    for (size_t i = 0; i < TEST_COMBINATION_COUNT; ++i) {
+        expected[i] = plugin.encode(test_combination(i).event());
+    }
+
+    std::atomic<size_t> divergent(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            // Every thread starts at a different offset, so that different
+            // keys are encoded at the same time
+            size_t offset = TEST_COMBINATION_COUNT * t / threads;
+            for (unsigned r = 0; r < rounds; ++r) {
+                for (size_t n = 0; n < TEST_COMBINATION_COUNT; ++n) {
+                    size_t i = (offset + n) % TEST_COMBINATION_COUNT;
+                    if (plugin.encode(test_combination(i).event()) != expected[i]) divergent++;
+                }
+            }
+        });
+    }
+    for (std::thread& w : workers) w.join();
+
+    std::cout << plugin.name() << ": " << threads << " threads x " << rounds << " rounds x "
+              << TEST_COMBINATION_COUNT << " combinations, " << divergent << " divergent outputs" << std::endl;
+    return divergent ? 1 : 0;
+}
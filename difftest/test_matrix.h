@@ -0,0 +1,99 @@
+#pragma once
+
+// The combination matrix of run_tests.py (the matrix keys of
+// common/key_db.py, mods_to_test, locks_to_test and kitty_flags_to_test).
+// difftest enumerates it in the same order, so that both drivers produce
+// identical result files; keep the modifiers, locks and flags in sync.
+
+#include <cstddef>
+#include <string>
+#include "../common/kt_plugin.h"
+
+struct TestKey {
+    const char* name;      // Key name passed to the encoders
+    unsigned keycode;      // evdev keycode (US QWERTY)
+    const char* base_key;  // Key in the US layout, or nullptr if it is one
+    const char* key_class; // letters, functional, keypad or non_ascii
+};
+
+// run_tests.py reads the same keys from common/key_db.py
+static const TestKey TEST_KEYS[] = {
+#include "test_keys.inc"
+};
+
+struct TestModifiers {
+    const char* combo;     // As printed in "Key: ..." combo strings
+    unsigned mods;         // KT_MOD_* bits
+};
+
+static const TestModifiers TEST_MODS[] = {
+    { "", 0 },
+    { "shift", KT_MOD_SHIFT },
+    { "ctrl", KT_MOD_CTRL },
+    { "alt", KT_MOD_ALT },
+    { "shift+ctrl", KT_MOD_SHIFT | KT_MOD_CTRL },
+    { "shift+alt", KT_MOD_SHIFT | KT_MOD_ALT },
+    { "ctrl+alt", KT_MOD_CTRL | KT_MOD_ALT },
+    { "shift+ctrl+alt", KT_MOD_SHIFT | KT_MOD_CTRL | KT_MOD_ALT },
+};
+
+static const TestModifiers TEST_LOCKS[] = {
+    { "", 0 },
+    { "caps", KT_MOD_CAPS },
+    { "num", KT_MOD_NUM },
+    { "caps+num", KT_MOD_CAPS | KT_MOD_NUM },
+};
+
+static const unsigned TEST_KITTY_FLAGS = 32; // Every combination of the 5 flag bits
+
+static const size_t TEST_KEY_COUNT = sizeof(TEST_KEYS) / sizeof(TEST_KEYS[0]);
+static const size_t TEST_MODS_COUNT = sizeof(TEST_MODS) / sizeof(TEST_MODS[0]);
+static const size_t TEST_LOCKS_COUNT = sizeof(TEST_LOCKS) / sizeof(TEST_LOCKS[0]);
+static const size_t TEST_COMBINATION_COUNT = TEST_KEY_COUNT * TEST_MODS_COUNT * TEST_LOCKS_COUNT * TEST_KITTY_FLAGS;
+
+// One entry of the matrix, decoded from its combination number
+struct TestCombination {
+    const TestKey* key;
+    const TestModifiers* mods;
+    const TestModifiers* locks;
+    unsigned flags;
+
+    kt_key_event event() const {
+        kt_key_event ev = {};
+        ev.key = key->name;
+        ev.base_key = key->base_key;
+        ev.keycode = key->keycode;
+        ev.mods = mods->mods | locks->mods;
+        ev.action = KT_ACTION_PRESS;
+        ev.kitty_flags = flags;
+        return ev;
+    }
+
+    // Kitty tester arguments without the flags, as in golden files:
+    // "--key a --shift --caps"
+    std::string input_args() const {
+        std::string args = std::string("--key ") + key->name;
+        for (const char* combo : { mods->combo, locks->combo }) {
+            std::string part = combo;
+            for (size_t start = 0; start < part.size(); ) {
+                size_t end = part.find('+', start);
+                if (end == std::string::npos) end = part.size();
+                args += " --" + part.substr(start, end - start);
+                start = end + 1;
+            }
+        }
+        if (key->base_key) args += std::string(" --base-key ") + key->base_key;
+        return args;
+    }
+};
+
+static inline TestCombination test_combination(size_t index) {
+    const size_t per_key = TEST_MODS_COUNT * TEST_LOCKS_COUNT * TEST_KITTY_FLAGS;
+    const size_t per_mods = TEST_LOCKS_COUNT * TEST_KITTY_FLAGS;
+    return {
+        &TEST_KEYS[index / per_key],
+        &TEST_MODS[index % per_key / per_mods],
+        &TEST_LOCKS[index % per_mods / TEST_KITTY_FLAGS],
+        (unsigned)(index % TEST_KITTY_FLAGS),
+    };
+}
@@ -3,7 +3,10 @@ import sys
 import os
 from pathlib import Path
 
-def extract_function_body(source_path, dest_path):
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'common'))
+from coverage_instrument import instrument, write_branch_table
+
+def extract_function_body(source_path, dest_path, coverage=False):
     if not os.path.exists(source_path):
         print(f"Error: Source file '{source_path}' not found.", file=sys.stderr)
         sys.exit(1)
@@ -47,6 +50,10 @@ def extract_function_body(source_path, dest_path):
         print(f"Error: Function body for '{func_sig}' not found or empty.", file=sys.stderr)
         sys.exit(1)
 
+    # Only the upstream code, not the simulation added below
+    if coverage:
+        body = instrument(body)
+
     with open(dest_path, 'w', encoding='utf-8') as f:
         f.writelines(body)
 
@@ -143,8 +150,12 @@ auto vkToEnChars = [](int vk) -> std::pair<char, char> {
 
 
     print(f"[*] Extracted far2l logic to '{dest_path}'")
+    if coverage:
+        print(f"[*] Instrumented {write_branch_table(dest_path)} branches")
 
 if __name__ == "__main__":
+    coverage = '--coverage' in sys.argv
+    sys.argv = [a for a in sys.argv if a != '--coverage']
     if len(sys.argv) < 2:
         # Default behavior for Makefile simplicity if called without args,
         # though Makefile should ideally pass them.
@@ -154,4 +165,4 @@ if __name__ == "__main__":
         source = sys.argv[1]
         dest = 'far2l_test/far2l_key_press_body.inc'
 
-    extract_function_body(source, dest)
\ No newline at end of file
+    extract_function_body(source, dest, coverage)
\ No newline at end of file
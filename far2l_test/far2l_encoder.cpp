@@ -0,0 +1,167 @@
+#include "far2l_mocks.h"
+#include "../common/kt_plugin.h"
+#include "../common/kt_keydb.h"
+#include "../common/kt_coverage.h" // KT_COV_HIT() of a COVERAGE=1 build
+#include "../common/kt_trace.h" // KT_TRACE() of a TRACE=1 build
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+// Include the extracted logic
+// The function signature matches the one found in source/vtshell_translation_kitty.cpp
+std::string VT_TranslateKeyToKitty(const KEY_EVENT_RECORD &KeyEvent, int flags, unsigned char keypad)
+{
+#include "far2l_key_press_body.inc"
+    // Fallback if the extracted body falls through (shouldn't happen usually with return statements)
+    return "";
+}
+
+struct KeyDef {
+    const char* name;
+    WORD vk;
+    WCHAR ch;
+    WCHAR shift_ch; // Character produced when Shift is pressed (simple emulation)
+};
+
+// Generated from common/key_db.py. Maps are based on the US standard
+// keyboard layout; keypad digits carry no character, with NumLock they
+// produce digits (see kt_encode).
+#include "far2l_keys.inc"
+
+static const KeyDef* find_key_def(const std::string& name) {
+    const KeyDef& def = key_table[kt_key_slot(name.c_str(), key_table_seeds, KEY_TABLE_BUCKETS, KEY_TABLE_SLOTS)];
+    return def.name && name == def.name ? &def : nullptr;
+}
+
+extern "C" KT_EXPORT int kt_abi_version(void) {
+    return KT_PLUGIN_ABI_VERSION;
+}
+
+extern "C" KT_EXPORT const char* kt_name(void) {
+    return "far2l";
+}
+
+static int encode_error(const std::string& msg, char* out, size_t out_size) {
+    snprintf(out, out_size, "%s", msg.c_str());
+    return KT_ENCODE_ERROR;
+}
+
+// Builds the KEY_EVENT_RECORD far2l would receive for `kev` and runs it
+// through VT_TranslateKeyToKitty(). Empty translations become "[EMPTY]".
+extern "C" KT_EXPORT int kt_encode(const kt_key_event* kev, char* out, size_t out_size) {
+    std::string key_name;
+    KEY_EVENT_RECORD ev = {};
+    ev.bKeyDown = 1;
+    ev.wRepeatCount = 1;
+
+    int kitty_flags = (int)kev->kitty_flags;
+    bool is_num = (kev->mods & KT_MOD_NUM) != 0;
+
+    if (kev->key) key_name = kev->key;
+    if (kev->mods & KT_MOD_SHIFT) ev.dwControlKeyState |= SHIFT_PRESSED;
+    // far2l usually checks LEFT or RIGHT, let's set LEFT by default
+    if (kev->mods & KT_MOD_CTRL) ev.dwControlKeyState |= LEFT_CTRL_PRESSED;
+    if (kev->mods & KT_MOD_ALT) ev.dwControlKeyState |= LEFT_ALT_PRESSED;
+    if (kev->mods & KT_MOD_CAPS) ev.dwControlKeyState |= CAPSLOCK_ON;
+    if (is_num) ev.dwControlKeyState |= NUMLOCK_ON;
+    // repeat not handled in simple test
+    if (kev->action == KT_ACTION_RELEASE) ev.bKeyDown = 0;
+
+    if (key_name.empty()) {
+        return encode_error("Error: --key missing", out, out_size);
+    }
+
+    // Keys of the Unicode sweep ("U+XXXX") are synthesised like the table's
+    // 'я': the virtual key of the US key they sit on, their character and
+    // the character Shift makes of it
+    KeyDef codepoint_def = {};
+    const KeyDef* found = find_key_def(key_name);
+    if (!found) {
+        if (WCHAR ch = (WCHAR)kt_key_codepoint(key_name.c_str())) {
+            char base = kev->base_key ? kev->base_key[0] : 0;
+            WCHAR shift_ch = (WCHAR)kt_key_codepoint(kev->shifted_key);
+            codepoint_def.name = kev->key;
+            codepoint_def.vk = (base >= 'a' && base <= 'z') ? (WORD)(base - 'a' + 'A') : (base >= '0' && base <= '9') ? (WORD)base : 0;
+            codepoint_def.ch = ch;
+            codepoint_def.shift_ch = shift_ch ? shift_ch : ch;
+            found = &codepoint_def;
+        }
+    }
+
+    // Special handling for KP_Enter which in Windows is usually VK_RETURN + ENHANCED_KEY
+    if (key_name == "KP_Enter") {
+        ev.wVirtualKeyCode = VK_RETURN;
+        ev.uChar.UnicodeChar = '\r';
+        ev.dwControlKeyState |= ENHANCED_KEY;
+    } else if (found) {
+        const KeyDef& def = *found;
+        ev.wVirtualKeyCode = def.vk;
+
+        WORD vk = ev.wVirtualKeyCode;
+        if (
+            vk == VK_INSERT  || vk == VK_DELETE ||
+            vk == VK_HOME    || vk == VK_END    ||
+            vk == VK_PRIOR   || vk == VK_NEXT   ||
+            vk == VK_UP      || vk == VK_DOWN   ||
+            vk == VK_LEFT    || vk == VK_RIGHT  ||
+            vk == VK_DIVIDE)
+        {
+            if (key_name.rfind("KP_", 0) != 0) // keypad keys are definitely not enhanced
+                ev.dwControlKeyState |= ENHANCED_KEY;
+        }
+
+        bool shift = (ev.dwControlKeyState & SHIFT_PRESSED);
+        bool ctrl = (ev.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED));
+        bool alt = (ev.dwControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED));
+
+        // Determine char code
+        // For simple letters/numbers:
+        if (def.ch != 0) {
+
+			bool isLetter = ev.wVirtualKeyCode >= 'A' && ev.wVirtualKeyCode <= 'Z';
+			bool useShifted = isLetter ? (shift ^ ((ev.dwControlKeyState & CAPSLOCK_ON) != 0)) : shift;
+			ev.uChar.UnicodeChar = useShifted ? def.shift_ch : def.ch;
+
+            // Ctrl behavior: usually transforms char to control code (1-26)
+            if (ctrl && !alt && def.ch < 128 && isalpha(def.ch)) {
+                ev.uChar.UnicodeChar = (WCHAR)(toupper(def.ch) - 'A' + 1);
+            }
+        }
+
+        // Numpad logic adjustment
+        // If it's a keypad key and NumLock is ON, it produces a digit/char
+        // If NumLock is OFF, it acts as navigation (VK_HOME etc), but run_tests passes KP_0...
+        // far2l logic handles VK_NUMPADx.
+        if (key_name.rfind("KP_", 0) == 0 && key_name.length() == 4 && isdigit(key_name[3])) {
+             if (is_num) {
+                 // Produce digit
+                 ev.uChar.UnicodeChar = key_name[3];
+             } else {
+                 // Acts as nav key, usually UnicodeChar is 0
+                 ev.uChar.UnicodeChar = 0;
+                 // Note: VK_NUMPAD0 etc are still the VK codes.
+                 // far2l logic might convert them to base keys (VK_INSERT etc) if they were passed that way,
+                 // but here we pass VK_NUMPADx and let far2l handle it (or not).
+                 // Actually far2l seems to expect VK_INSERT if NumLock is off?
+                 // Let's check source logic... logic uses `VK_NUMPAD0` in switch.
+                 // It seems far2l expects OS to translate scan codes.
+                 // For testing purposes, we stick to VK_NUMPADx unless we want to simulate full driver.
+             }
+        }
+
+    } else {
+        return encode_error("Error: Unknown key " + key_name, out, out_size);
+    }
+
+    // Call the function
+    std::string result = VT_TranslateKeyToKitty(ev, kitty_flags, 0);
+    KT_TRACE("VT_TranslateKeyToKitty: vk=0x%x char=0x%x control_state=0x%x down=%u flags=%u -> %u bytes",
+             ev.wVirtualKeyCode, ev.uChar.UnicodeChar, ev.dwControlKeyState, ev.bKeyDown, kitty_flags, result.size());
+
+    if (result.empty()) result = "[EMPTY]";
+    size_t len = std::min(result.size(), out_size);
+    memcpy(out, result.data(), len);
+    return (int)len;
+}
+
@@ -148,8 +148,9 @@ static inline std::string Wide2MB(const WCHAR* wstr) {
 
 // Full mock of legacy key translation
 static inline const char* VT_TranslateSpecialKey(WORD vk, bool ctrl, bool alt, bool shift, unsigned char /*keypad*/, WCHAR) {
-    static char buf[64];
-    
+    // The upstream signature returns a pointer, so the buffer is per thread
+    static thread_local char buf[64];
+
     int mod = 1;
     if (shift) mod += 1;
     if (alt)   mod += 2;
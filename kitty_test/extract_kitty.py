@@ -2,9 +2,12 @@
 import sys
 import os
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'common'))
+from coverage_instrument import instrument, write_branch_table
+
 DEST_PATH = 'kitty_test/kitty_encoder_body.inc'
 
-def extract(source_path):
+def extract(source_path, coverage=False):
     if not os.path.exists(source_path):
         print(f"Error: Source file '{source_path}' not found.", file=sys.stderr)
         sys.exit(1)
@@ -12,6 +15,9 @@ def extract(source_path):
     with open(source_path, 'r', encoding='utf-8') as f:
         lines = f.readlines()
 
+    if coverage:
+        lines = instrument(lines)
+
     with open(DEST_PATH, 'w', encoding='utf-8') as f:
         f.write("// Extracted from " + os.path.basename(source_path) + "\n")
         for line in lines:
@@ -21,9 +27,12 @@ def extract(source_path):
                 f.write(line)
     
     print(f"[*] Processed '{source_path}' into '{DEST_PATH}'")
+    if coverage:
+        print(f"[*] Instrumented {write_branch_table(DEST_PATH)} branches")
 
 if __name__ == "__main__":
-    if len(sys.argv) < 2:
-        print("Usage: python3 extract_kitty.py <path_to_key_encoding.c>", file=sys.stderr)
+    args = [a for a in sys.argv[1:] if a != '--coverage']
+    if len(args) < 1:
+        print("Usage: python3 extract_kitty.py <path_to_key_encoding.c> [--coverage]", file=sys.stderr)
         sys.exit(1)
-    extract(sys.argv[1])
\ No newline at end of file
+    extract(args[0], coverage='--coverage' in sys.argv)
\ No newline at end of file
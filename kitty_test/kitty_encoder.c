@@ -0,0 +1,192 @@
+#include "kitty_mocks.h"
+#include "../common/kt_coverage.h" // KT_COV_HIT() of a COVERAGE=1 build
+#include "../common/kt_trace.h" // KT_TRACE() of a TRACE=1 build
+#include "kitty_encoder_body.inc"
+#include "../common/kt_plugin.h"
+#include "../common/kt_keydb.h"
+#include <string.h>
+
+typedef struct {
+    const char* name;
+    int key;
+    int shifted_key;
+    const char* numpad_text;
+} KeyInfo;
+
+// Generated from common/key_db.py
+#include "kitty_keys.inc"
+
+// Encodes a single Unicode codepoint into a UTF-8 string buffer
+static void encode_codepoint_to_utf8(uint32_t cp, char* buf) {
+    if (cp < 0x80) {
+        buf[0] = cp;
+        buf[1] = '\0';
+    } else if (cp < 0x800) {
+        buf[0] = 0xC0 | (cp >> 6);
+        buf[1] = 0x80 | (cp & 0x3F);
+        buf[2] = '\0';
+    } else if (cp < 0x10000) {
+        buf[0] = 0xE0 | (cp >> 12);
+        buf[1] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[2] = 0x80 | (cp & 0x3F);
+        buf[3] = '\0';
+    } else {
+        buf[0] = 0xF0 | (cp >> 18);
+        buf[1] = 0x80 | ((cp >> 12) & 0x3F);
+        buf[2] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[3] = 0x80 | (cp & 0x3F);
+        buf[4] = '\0';
+    }
+}
+static const KeyInfo* find_key_info(const char* name) {
+    const KeyInfo* info = &key_table[kt_key_slot(name, key_table_seeds, KEY_TABLE_BUCKETS, KEY_TABLE_SLOTS)];
+    return info->name && strcmp(info->name, name) == 0 ? info : NULL;
+}
+
+KT_EXPORT int kt_abi_version(void) {
+    return KT_PLUGIN_ABI_VERSION;
+}
+
+KT_EXPORT const char* kt_name(void) {
+    return "kitty";
+}
+
+// Encodes one event with kitty's encode_glfw_key_event(). The output is what
+// kitty would send to the child: either the escape sequence or the text.
+KT_EXPORT int kt_encode(const kt_key_event* kev, char* out, size_t out_size) {
+    GLFWkeyevent ev;
+    memset(&ev, 0, sizeof(ev));
+
+    const char* key_name = kev->key;
+    unsigned int kitty_flags = kev->kitty_flags;
+    bool cursor_key_mode = kev->cursor_key_mode != 0;
+    bool has_mods_that_prevent_text = (kev->mods & (KT_MOD_CTRL | KT_MOD_ALT | KT_MOD_SUPER)) != 0;
+    const char* base_key_str = kev->base_key;
+    const char* shifted_key_str = kev->shifted_key;
+
+    if (kev->mods & KT_MOD_SHIFT) ev.mods |= GLFW_MOD_SHIFT;
+    if (kev->mods & KT_MOD_CTRL) ev.mods |= GLFW_MOD_CONTROL;
+    if (kev->mods & KT_MOD_ALT) ev.mods |= GLFW_MOD_ALT;
+    if (kev->mods & KT_MOD_SUPER) ev.mods |= GLFW_MOD_SUPER;
+    if (kev->mods & KT_MOD_CAPS) ev.mods |= GLFW_MOD_CAPS_LOCK;
+    if (kev->mods & KT_MOD_NUM) ev.mods |= GLFW_MOD_NUM_LOCK;
+
+    if (kev->action == KT_ACTION_RELEASE) ev.action = GLFW_RELEASE;
+    else if (kev->action == KT_ACTION_REPEAT) ev.action = GLFW_REPEAT;
+    else ev.action = GLFW_PRESS;
+
+    if (!key_name) {
+        snprintf(out, out_size, "Error: --key argument is missing.");
+        return KT_ENCODE_ERROR;
+    }
+
+    KeyInfo codepoint_key;
+    uint32_t key_cp = 0, shifted_cp = 0;
+    const KeyInfo* key_info = find_key_info(key_name);
+    if (!key_info && (key_cp = kt_key_codepoint(key_name))) {
+        // Keys of other layouts and of the Unicode sweep are described by their codepoints
+        shifted_cp = kt_key_codepoint(shifted_key_str);
+        if (shifted_key_str && !shifted_cp) {
+            snprintf(out, out_size, "Error: Invalid shifted key '%s'.", shifted_key_str);
+            return KT_ENCODE_ERROR;
+        }
+        codepoint_key.name = key_name;
+        codepoint_key.key = key_cp;
+        codepoint_key.shifted_key = shifted_cp;
+        codepoint_key.numpad_text = NULL;
+        key_info = &codepoint_key;
+    }
+    if (!key_info) {
+        snprintf(out, out_size, "Error: Unknown key name '%s'.", key_name);
+        return KT_ENCODE_ERROR;
+    }
+    ev.key = key_info->key;
+    ev.shifted_key = key_info->shifted_key;
+
+    // Apply Caps Lock effect to shifted_key
+    // If Caps Lock is on, the "Shifted" version of a letter is lowercase
+    if ((ev.mods & GLFW_MOD_CAPS_LOCK) && ev.key >= 'a' && ev.key <= 'z') {
+        if (ev.shifted_key >= 'A' && ev.shifted_key <= 'Z') {
+             ev.shifted_key = ev.shifted_key + ('a' - 'A');
+        }
+    }
+
+    // If shifted_key is same as key (e.g. Shift+Caps+a -> 'a', key is 'a'),
+    // it provides no info and should be 0 to match real behavior
+    if (ev.shifted_key == ev.key) {
+        ev.shifted_key = 0;
+    }
+
+    char text_buf[8] = {0};
+    // The mocked functional keys overlap Latin Extended-A, codepoint keys are never functional
+    bool is_codepoint_key = key_info == &codepoint_key;
+    bool is_function_key = !is_codepoint_key && key_info->key >= GLFW_FKEY_FIRST && key_info->key <= GLFW_FKEY_LAST;
+    if (!has_mods_that_prevent_text && !is_function_key) {
+        bool shift_active = (ev.mods & GLFW_MOD_SHIFT) != 0;
+        bool caps_active = (ev.mods & GLFW_MOD_CAPS_LOCK) != 0;
+        bool effective_shift = shift_active ^ caps_active;
+
+        // A printable unicode character, but not a PUA functional key
+        if (key_info->key > 127 && (key_info->key < 57344 || is_codepoint_key)) {
+            // Characters without a case mapping type themselves whatever the modifiers
+            uint32_t codepoint = effective_shift && key_info->shifted_key ? key_info->shifted_key : key_info->key;
+            encode_codepoint_to_utf8(codepoint, text_buf);
+            ev.text = text_buf;
+        } else if (key_info->key >= 'a' && key_info->key <= 'z') {
+            text_buf[0] = effective_shift ? (char)key_info->shifted_key : (char)key_info->key;
+            text_buf[1] = '\0';
+            ev.text = text_buf;
+        } else if (key_info->shifted_key != 0) {
+            text_buf[0] = shift_active ? (char)key_info->shifted_key : (char)key_info->key;
+            text_buf[1] = '\0';
+            ev.text = text_buf;
+        } else if (key_info->key < 256) {
+             text_buf[0] = (char)key_info->key;
+             text_buf[1] = '\0';
+             ev.text = text_buf;
+        }
+
+        if (key_info->numpad_text && (ev.mods & GLFW_MOD_NUM_LOCK)) {
+             text_buf[0] = key_info->numpad_text[0];
+             text_buf[1] = '\0';
+             ev.text = text_buf;
+        }
+    }
+
+    // Set alternate_key (Base Layout Key)
+    if (base_key_str && base_key_str[0]) {
+        ev.alternate_key = base_key_str[0];
+    } else {
+        // Default base key logic for ASCII when not provided
+        uint32_t potential_alt = 0;
+        if (ev.key < 128) {
+            if (ev.key >= 'A' && ev.key <= 'Z') potential_alt = ev.key + 32;
+            else if (ev.key >= 'a' && ev.key <= 'z') potential_alt = ev.key;
+            // For other ASCII like punctuation, base key is the key itself, so we don't set it unless different
+        }
+        if (potential_alt != 0 && potential_alt != ev.key) {
+            ev.alternate_key = potential_alt;
+        }
+    }
+
+    char output[KEY_BUFFER_SIZE];
+    memset(output, 0, KEY_BUFFER_SIZE);
+
+    int result = encode_glfw_key_event(&ev, cursor_key_mode, kitty_flags, output);
+
+    int out_len = 0;
+    if (result == SEND_TEXT_TO_CHILD) {
+        if (ev.text) {
+            out_len = strlen(ev.text);
+            memcpy(out, ev.text, out_len);
+        }
+    } else if (result > 0) {
+        out_len = (size_t)result < out_size ? result : (int)out_size;
+        memcpy(out, output, out_len);
+    }
+
+    KT_TRACE("encode_glfw_key_event: key=%u shifted=%u mods=0x%x flags=%u action=%u -> %d",
+             ev.key, ev.shifted_key, ev.mods, kitty_flags, ev.action, result);
+
+    return out_len;
+}
@@ -4,112 +4,163 @@ import itertools
 import os
 import json
 import sys
+import select
 import argparse
+import hashlib
+import bisect
+import heapq
+import sqlite3
+import textwrap
+import copy
+import re
+import time
+import unicodedata
+import tempfile
+import shutil
 from collections import defaultdict
+from contextlib import contextmanager
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'common'))
+from key_db import matrix_keys, unicode_sweep_keys
+from covering_array import covering_array, uncovered_interactions
 
 # Configuration
 KITTY_TESTER = "./build/bin/kitty_tester"
 RESULTS_FILE = "test_results.json"
 MISMATCH_LOG_FILE = "mismatches.log"
-SAVE_INTERVAL = 100
+# The mismatches grouped by root cause, one line per group
+MISMATCH_CLUSTERS_FILE = "mismatch_clusters.log"
+# Where the time of a run went: phases, tester latencies and throughput
+PROFILE_FILE = "test_profile.json"
+# Runs of several targets: which combinations fail in one target but not another
+CROSS_TARGET_FILE = "cross_target.log"
+# Append-only log of every outcome, finalised into RESULTS_FILE, MISMATCH_LOG_FILE and MISMATCH_CLUSTERS_FILE
+RESULTS_LOG_FILE = "test_results.jsonl"
+# The log of the run --incremental reuses outputs from, while the new log is written
+PREVIOUS_LOG_SUFFIX = ".prev"
+# The combinations of a target that failed or changed status in recent runs, which --failures-first runs first
+FAILURE_HISTORY_FILE = "failure_history.json" # failure_history.<target>.json
+HISTORY_RUNS = 10 # Runs a combination stays in the history after it last failed or changed status
+# Output recorded for combinations --stop-key-after did not run
+NOT_RUN_OUTPUT = "[NOT RUN]"
 COMMAND_TIMEOUT = 2
+# Compiled xkb keymaps are serialised here so that later VTE tester processes skip compilation
+KEYMAP_CACHE_DIR = "./build/xkb_cache"
+# Persistent cache of kitty reference outputs, one database per revision of KITTY_CACHE_INPUTS
+KITTY_CACHE_DIR = "./build/kitty_cache"
+KITTY_CACHE_INPUTS = [
+    "kitty_test/kitty_encoder_body.inc",
+    "kitty_test/kitty_mocks.h",
+    "kitty_test/kitty_encoder.c",
+    "kitty_test/kitty_tester.c",
+    "common/kt_cli.c",
+    "common/kt_plugin.h",
+    "common/key_db.py",
+    "common/kt_keydb.h",
+]
+KITTY_CACHE_COMMIT_INTERVAL = 100 # Batches between cache commits
+# Branch table written next to the extracted kitty body by 'make COVERAGE=1'
+KITTY_BRANCHES = "kitty_test/kitty_encoder_body.inc.branches"
+KT_COV_MAP_BYTES = 512 # common/kt_coverage.h
+# Dimensions of the combination matrix besides the keys: every subset of
+# the modifiers and of the locks, and every kitty flags value
+MODIFIERS = ['--shift', '--ctrl', '--alt']
+LOCKS = ['--caps', '--num']
+KITTY_FLAG_BITS = 5
+# Number of combinations pipelined through a --stream tester at once.
+# Kept small enough that requests and replies always fit into the pipe buffers.
+STREAM_BATCH = 64
+# Key/modifier/lock cells analysed at once by --collapse-flags
+COLLAPSE_CELLS = 8
 
 # Definition of test targets
-def build_vte_cmd(binary, base_cmd, key_info, flags):
+def build_base_cmd(key_info, mods, locks):
+    # Keys of non-US layouts are passed to the testers by codepoint ("U+044F")
+    return ['--key', key_info.get('arg', key_info['name'])] + mods + locks
+
+def kitty_key_args(key_info):
+    # Extra key description kitty cannot derive from the key name alone
+    args = []
+    if 'base_key' in key_info:
+        args.extend(['--base-key', key_info['base_key']])
+    if 'shifted' in key_info:
+        args.extend(['--shifted-key', key_info['shifted']])
+    return args
+
+def build_kitty_args(base_cmd, key_info, flags):
+    return base_cmd + ['--kitty-flags', str(flags)] + kitty_key_args(key_info)
+
+def build_vte_args(base_cmd, key_info, flags):
     # VTE tester needs the explicit EVDEV keycode
-    return [binary] + base_cmd + ['--keycode', str(key_info['keycode']), '--kitty-flags', str(flags)]
+    args = base_cmd + ['--keycode', str(key_info['keycode']), '--kitty-flags', str(flags)]
+    if 'layout' in key_info:
+        args.extend(['--layout', key_info['layout']])
+    return args
 
-def build_far2l_cmd(binary, base_cmd, key_info, flags):
+def codepoint_key_args(key_info):
+    # Keys given by codepoint have no table entry in the tester to take the
+    # shifted and base key from
+    return kitty_key_args(key_info) if 'arg' in key_info else []
+
+def build_far2l_args(base_cmd, key_info, flags):
     # Far2l tester maps names internally, keycode is ignored
-    return [binary] + base_cmd + ['--kitty-flags', str(flags)]
+    return base_cmd + ['--kitty-flags', str(flags)] + codepoint_key_args(key_info)
 
-def build_alacritty_cmd(binary, base_cmd, key_info, flags):
+def build_alacritty_args(base_cmd, key_info, flags):
     # Alacritty tester maps names internally based on the key name
-    return [binary] + base_cmd + ['--kitty-flags', str(flags)]
+    return base_cmd + ['--kitty-flags', str(flags)] + codepoint_key_args(key_info)
+
+# Sources the output of every tester depends on
+TESTER_COMMON_INPUTS = ["common/kt_cli.c", "common/kt_plugin.h", "common/key_db.py", "common/kt_keydb.h"]
 
 TARGETS = {
     'vte': {
         'binary': './build/bin/vte_tester',
-        'cmd_builder': build_vte_cmd,
+        'inputs': [
+            "vte_test/vte_key_press_body.inc",
+            "vte_test/vte_key_tester.cc",
+            "vte_test/vte_key_tester.h",
+            "vte_test/keysym_tables.inc",
+            "vte_test/vte_encoder.cc",
+            "vte_test/keymap_pool.cc",
+            "vte_test/keymap_pool.h",
+            "vte_test/kittykeys.h",
+            "vte_test/main.cc",
+        ] + TESTER_COMMON_INPUTS,
+        'args_builder': build_vte_args,
+        'tester_args': ['--keymap-cache', KEYMAP_CACHE_DIR],
+        'branches': "vte_test/vte_key_press_body.inc.branches",
+        'supports_layouts': True,
         'is_fallback': lambda out: out == "[LEGACY_FALLBACK]" or out == "[EMPTY]"
     },
     'far2l': {
         'binary': './build/bin/far2l_tester',
-        'cmd_builder': build_far2l_cmd,
+        'inputs': [
+            "far2l_test/far2l_key_press_body.inc",
+            "far2l_test/far2l_encoder.cpp",
+            "far2l_test/far2l_mocks.h",
+            "far2l_test/far2l_tester.cpp",
+        ] + TESTER_COMMON_INPUTS,
+        'args_builder': build_far2l_args,
+        'branches': "far2l_test/far2l_key_press_body.inc.branches",
         'is_fallback': lambda out: out == "[EMPTY]"
     },
     'alacritty': {
         'binary': './build/bin/alacritty_tester',
-        'cmd_builder': build_alacritty_cmd,
+        'inputs': [
+            "alacritty_test/alacritty_extracted.rs",
+            "alacritty_test/alacritty_encoder.rs",
+            "alacritty_test/alacritty_mocks.rs",
+            "alacritty_test/alacritty_tester.rs",
+        ],
+        'args_builder': build_alacritty_args,
         'is_fallback': lambda out: out == "[EMPTY]"
     }
 }
 
-# Standard X11/evdev keycodes for US QWERTY layout
-# Used by VTE (requires evdev codes) and generic iteration
-key_map = {
-    'a': {'name': 'a', 'keycode': 38}, 'b': {'name': 'b', 'keycode': 56}, 'c': {'name': 'c', 'keycode': 54},
-    'd': {'name': 'd', 'keycode': 40}, 'e': {'name': 'e', 'keycode': 26}, 'f': {'name': 'f', 'keycode': 41},
-    'g': {'name': 'g', 'keycode': 42}, 'h': {'name': 'h', 'keycode': 43}, 'i': {'name': 'i', 'keycode': 31},
-    'j': {'name': 'j', 'keycode': 44}, 'k': {'name': 'k', 'keycode': 45}, 'l': {'name': 'l', 'keycode': 46},
-    'm': {'name': 'm', 'keycode': 58}, 'n': {'name': 'n', 'keycode': 57}, 'o': {'name': 'o', 'keycode': 32},
-    'p': {'name': 'p', 'keycode': 33}, 'q': {'name': 'q', 'keycode': 24}, 'r': {'name': 'r', 'keycode': 27},
-    's': {'name': 's', 'keycode': 39}, 't': {'name': 't', 'keycode': 28}, 'u': {'name': 'u', 'keycode': 30},
-    'v': {'name': 'v', 'keycode': 55}, 'w': {'name': 'w', 'keycode': 25}, 'x': {'name': 'x', 'keycode': 53},
-    'y': {'name': 'y', 'keycode': 29}, 'z': {'name': 'z', 'keycode': 52},
-
-    # Numbers row
-    '1': {'name': '1', 'keycode': 10}, '2': {'name': '2', 'keycode': 11}, '3': {'name': '3', 'keycode': 12},
-    '4': {'name': '4', 'keycode': 13}, '5': {'name': '5', 'keycode': 14}, '6': {'name': '6', 'keycode': 15},
-    '7': {'name': '7', 'keycode': 16}, '8': {'name': '8', 'keycode': 17}, '9': {'name': '9', 'keycode': 18},
-    '0': {'name': '0', 'keycode': 19},
-
-    # Top row symbols
-    '`': {'name': '`', 'keycode': 49}, '~': {'name': '~', 'keycode': 49},
-    '-': {'name': 'minus', 'keycode': 20}, '_': {'name': '_', 'keycode': 20},
-    '=': {'name': 'equal', 'keycode': 21}, '+': {'name': '+', 'keycode': 21},
-    # Brackets & Slashes
-    '[': {'name': 'bracketleft', 'keycode': 34}, '{': {'name': '{', 'keycode': 34},
-    ']': {'name': 'bracketright', 'keycode': 35}, '}': {'name': '}', 'keycode': 35},
-    '\\': {'name': 'backslash', 'keycode': 51}, '|': {'name': '|', 'keycode': 51},
-    ';': {'name': 'semicolon', 'keycode': 47}, ':': {'name': ':', 'keycode': 47},
-    "'": {'name': 'apostrophe', 'keycode': 48}, '"': {'name': '"', 'keycode': 48},
-    ',': {'name': 'comma', 'keycode': 59}, '<': {'name': '<', 'keycode': 59},
-    '.': {'name': 'period', 'keycode': 60}, '>': {'name': '>', 'keycode': 60},
-    '/': {'name': 'slash', 'keycode': 61}, '?': {'name': '?', 'keycode': 61},
-
-    # Function keys (F1=67 in evdev)
-    **{f'F{i}': {'name': f'F{i}', 'keycode': 66 + i} for i in range(1, 13)},
-
-    # Control keys
-    'Escape': {'name': 'Escape', 'keycode': 9},
-    'Tab': {'name': 'Tab', 'keycode': 23},
-    'Return': {'name': 'Return', 'keycode': 36},
-    'BackSpace': {'name': 'BackSpace', 'keycode': 22},
-    'space': {'name': 'space', 'keycode': 65},
-
-    # Navigation
-    'Insert': {'name': 'Insert', 'keycode': 118},
-    'Delete': {'name': 'Delete', 'keycode': 119},
-    'Home': {'name': 'Home', 'keycode': 110},
-    'End': {'name': 'End', 'keycode': 115},
-    'Page_Up': {'name': 'Page_Up', 'keycode': 112},
-    'Page_Down': {'name': 'Page_Down', 'keycode': 117},
-
-    # Arrows
-    'Up': {'name': 'Up', 'keycode': 111},
-    'Down': {'name': 'Down', 'keycode': 116},
-    'Left': {'name': 'Left', 'keycode': 113},
-    'Right': {'name': 'Right', 'keycode': 114},
-
-    # Keypad (NumLock ON usually implies these codes)
-    **{f'KP_{i}': {'name': f'KP_{i}', 'keycode': 86 - (9-i) if i!=0 else 90} for i in range(10)},
-    'KP_Home': {'name': 'KP_Home', 'keycode': 79},
-    'KP_End': {'name': 'KP_End', 'keycode': 87},
-    # Non-English Layouts
-    # 'я' corresponds to physical 'z' (keycode 52) on standard Russian layout
-    'я': {'name': 'я', 'keycode': 52, 'base_key': 'z'},
-}
+# Keys of the combination matrix, with their evdev keycodes in the US
+# QWERTY layout (VTE needs them), from the key database shared with the testers
+MATRIX_KEYS = matrix_keys()
 
 def format_raw_output(raw_bytes):
     if not raw_bytes:
@@ -136,73 +187,1588 @@ def run_command(cmd_args, debug=False):
     except Exception as e:
         return f"[ERROR: {str(e)}]".encode()
 
+class ProcessTester:
+    """Runs the tester binary once per combination."""
+
+    def __init__(self, binary, tester_args=(), debug=False):
+        self.binary = binary
+        self.tester_args = list(tester_args)
+        self.debug = debug
+        self.pending = []
+        # Seconds per request of the last collect(), process spawn included
+        self.latencies = []
+        self.spawns = 0
+        self.spawn_seconds = 0.0
+
+    def submit(self, arg_lists):
+        self.pending = arg_lists
+
+    def collect(self):
+        outputs = []
+        self.latencies = []
+        for args in self.pending:
+            start = time.perf_counter()
+            outputs.append(run_command([self.binary] + args + self.tester_args, self.debug))
+            self.latencies.append(time.perf_counter() - start)
+        self.spawns += len(self.pending)
+        self.pending = []
+        return outputs
+
+    def close(self):
+        pass
+
+class StreamingTester:
+    """Keeps one tester process alive in --stream mode and pipelines requests through it."""
+
+    def __init__(self, binary, tester_args=(), debug=False):
+        self.binary = binary
+        self.tester_args = list(tester_args)
+        self.debug = debug
+        self.proc = None
+        self.buf = bytearray()
+        self.pending = []
+        # Hex branch bitmaps of the last collect() for requests with --coverage, else None
+        self.coverage = []
+        self.reply_coverage = None
+        # Trace records of the last collect() for requests with --trace, else None
+        self.traces = []
+        self.reply_trace = None
+        # Seconds per request of the last collect(): from the previous reply
+        # (or the submit) to its own, so pipelined requests are not counted twice
+        self.latencies = []
+        self.submitted_at = 0.0
+        self.spawns = 0
+        self.spawn_seconds = 0.0
+
+    def _start(self):
+        start = time.perf_counter()
+        self.proc = subprocess.Popen([self.binary, '--stream'] + self.tester_args, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=None if self.debug else subprocess.DEVNULL)
+        self.buf = bytearray()
+        self.spawns += 1
+        self.spawn_seconds += time.perf_counter() - start
+
+    def _kill(self):
+        if self.proc:
+            self.proc.kill()
+            self.proc.wait()
+            self.proc = None
+
+    def _fill(self):
+        ready, _, _ = select.select([self.proc.stdout], [], [], COMMAND_TIMEOUT)
+        if not ready:
+            raise subprocess.TimeoutExpired(self.binary, COMMAND_TIMEOUT)
+        chunk = os.read(self.proc.stdout.fileno(), 65536)
+        if not chunk:
+            raise EOFError()
+        self.buf += chunk
+
+    def _read_reply(self):
+        while b'\n' not in self.buf:
+            self._fill()
+        header, _, rest = bytes(self.buf).partition(b'\n')
+        status, length, *extra = header.split()
+        length = int(length)
+        # "T<n>": n bytes of trace records follow the payload
+        trace_length = next((int(token[1:]) for token in extra if token.startswith(b'T')), 0)
+        self.reply_coverage = next((token.decode() for token in extra if not token.startswith(b'T')), None)
+        self.buf = bytearray(rest)
+        while len(self.buf) < length + trace_length:
+            self._fill()
+        payload = bytes(self.buf[:length])
+        self.reply_trace = self.buf[length:length + trace_length].decode('utf-8', 'replace') if trace_length else None
+        del self.buf[:length + trace_length]
+        if status == b'ERR':
+            return f"[ERROR: {payload.decode('utf-8', 'replace')}]".encode()
+        return payload.strip()
+
+    def submit(self, arg_lists):
+        if self.proc is None:
+            self._start()
+        self.pending = arg_lists
+        self.submitted_at = time.perf_counter()
+        lines = "".join(" ".join(args) + "\n" for args in arg_lists)
+        if self.debug:
+            for args in arg_lists:
+                print(f"\n[DEBUG] Streaming to {self.binary}: {' '.join(args)}", file=sys.stderr)
+        try:
+            self.proc.stdin.write(lines.encode('utf-8'))
+            self.proc.stdin.flush()
+        except OSError:
+            pass # Reported as a failed reply in collect()
+
+    def collect(self):
+        outputs = []
+        self.coverage = []
+        self.traces = []
+        self.latencies = []
+        last = self.submitted_at
+        while self.pending:
+            try:
+                outputs.append(self._read_reply())
+                self.coverage.append(self.reply_coverage)
+                self.traces.append(self.reply_trace)
+                self.pending = self.pending[1:]
+                now = time.perf_counter()
+                self.latencies.append(now - last)
+                last = now
+            except subprocess.TimeoutExpired:
+                outputs.append(f"[ERROR: Command timed out after {COMMAND_TIMEOUT}s]".encode())
+                self.coverage.append(None)
+                self.traces.append(None)
+                self._restart_after_failure()
+            except (EOFError, ValueError, OSError):
+                self._kill()
+                outputs.append(f"[ERROR: Tester process died while running: {' '.join(self.pending[0])}]".encode())
+                self.coverage.append(None)
+                self.traces.append(None)
+                self._restart_after_failure()
+        return outputs
+
+    def _restart_after_failure(self):
+        # Drop the failed request and resubmit the rest to a fresh process
+        self._kill()
+        remaining = self.pending[1:]
+        self.pending = []
+        if remaining:
+            self.submit(remaining)
+
+    def close(self):
+        if self.proc:
+            self.proc.stdin.close()
+            self.proc.wait()
+            self.proc = None
+
+class CachedTester:
+    """Answers requests from a persistent cache and forwards only the misses to the wrapped tester."""
+
+    def __init__(self, tester, path):
+        self.tester = tester
+        self.db = sqlite3.connect(path, timeout=30)
+        self.db.execute("CREATE TABLE IF NOT EXISTS outputs (args TEXT PRIMARY KEY, output BLOB NOT NULL)")
+        self.pending = None
+        self.batches = 0
+        self.hits = 0
+        self.misses = 0
+        # Latencies of the misses only, cache hits cost no tester request
+        self.latencies = []
+
+    def submit(self, arg_lists):
+        keys = [" ".join(args) for args in arg_lists]
+        unique = list(set(keys))
+        placeholders = ",".join("?" * len(unique))
+        cached = dict(self.db.execute(f"SELECT args, output FROM outputs WHERE args IN ({placeholders})", unique))
+        misses = [args for args, key in zip(arg_lists, keys) if key not in cached]
+        if misses:
+            self.tester.submit(misses)
+        self.pending = (keys, cached, bool(misses))
+
+    @property
+    def spawns(self):
+        return self.tester.spawns
+
+    @property
+    def spawn_seconds(self):
+        return self.tester.spawn_seconds
+
+    def collect(self):
+        keys, cached, has_misses = self.pending
+        fresh = iter(self.tester.collect() if has_misses else [])
+        self.latencies = self.tester.latencies if has_misses else []
+        outputs = []
+        new_rows = []
+        for key in keys:
+            if key in cached:
+                outputs.append(cached[key])
+                self.hits += 1
+            else:
+                output = next(fresh)
+                outputs.append(output)
+                self.misses += 1
+                # Failures may be transient (timeouts), so they are never cached
+                if not output.startswith(b"[ERROR:"):
+                    new_rows.append((key, output))
+        if new_rows:
+            self.db.executemany("INSERT OR REPLACE INTO outputs (args, output) VALUES (?, ?)", new_rows)
+        self.batches += 1
+        if self.batches % KITTY_CACHE_COMMIT_INTERVAL == 0:
+            self.db.commit()
+        self.pending = None
+        return outputs
+
+    def close(self):
+        self.tester.close()
+        self.db.commit()
+        self.db.close()
+        print(f"Kitty cache: {self.hits} hits, {self.misses} misses")
+
+def hash_inputs(paths):
+    digest = hashlib.sha256()
+    for path in paths:
+        with open(path, 'rb') as f:
+            data = f.read()
+        digest.update(f"{path}\0{len(data)}\0".encode())
+        digest.update(data)
+    return digest.hexdigest()[:32]
+
+def kitty_cache_path():
+    # The reference output depends only on these sources and the combination,
+    # so their hash names the cache. Any change starts a fresh cache.
+    return os.path.join(KITTY_CACHE_DIR, hash_inputs(KITTY_CACHE_INPUTS) + ".sqlite")
+
+def make_tester(binary, args, tester_args=()):
+    if args.no_stream:
+        return ProcessTester(binary, tester_args, args.debug)
+    return StreamingTester(binary, tester_args, args.debug)
+
+def make_kitty_tester(args):
+    tester = make_tester(KITTY_TESTER, args)
+    # Cached outputs come without coverage or traces
+    if args.no_cache or args.coverage or args.trace:
+        return tester
+    try:
+        path = kitty_cache_path()
+    except OSError as e:
+        print(f"Warning: Kitty cache disabled, cannot hash its inputs: {e}", file=sys.stderr)
+        return tester
+
+    os.makedirs(KITTY_CACHE_DIR, exist_ok=True)
+    # Caches of older kitty revisions can never hit again
+    for name in os.listdir(KITTY_CACHE_DIR):
+        stale = os.path.join(KITTY_CACHE_DIR, name)
+        if name.endswith(".sqlite") and stale != path:
+            os.remove(stale)
+    return CachedTester(tester, path)
+
+def load_layout_keys(layout, vte_conf):
+    """Builds the key list of a non-US xkb layout from the VTE tester's view of it."""
+    def dump(name):
+        cmd = [vte_conf['binary'], '--dump-layout', name] + vte_conf['tester_args']
+        result = subprocess.run(cmd, capture_output=True, check=True)
+        table = {}
+        for line in result.stdout.decode().splitlines():
+            keycode, unshifted, shifted = (int(v) for v in line.split())
+            table[keycode] = (unshifted, shifted)
+        return table
+
+    us_table = dump('us')
+    layout_table = dump(layout)
+    # Only the physical keys the US matrix covers; keys producing the same
+    # characters as in the US layout would just repeat US combinations
+    tested_keycodes = {k['keycode'] for k in MATRIX_KEYS}
+
+    keys = []
+    for keycode, (unshifted, shifted) in sorted(layout_table.items()):
+        if keycode not in tested_keycodes or keycode not in us_table or unshifted <= 0x20:
+            continue
+        if layout_table[keycode] == us_table[keycode]:
+            continue
+        key_info = {'name': chr(unshifted), 'arg': f"U+{unshifted:04X}", 'keycode': keycode, 'layout': layout}
+        if shifted > 0x20 and shifted != unshifted:
+            key_info['shifted'] = f"U+{shifted:04X}"
+        us_char = chr(us_table[keycode][0])
+        if us_char != chr(unshifted):
+            key_info['base_key'] = us_char
+        keys.append(key_info)
+    return keys
+
+def hashable(value):
+    # Lists and dicts (key_info) as nested tuples
+    if isinstance(value, dict):
+        return tuple(sorted((k, hashable(v)) for k, v in value.items()))
+    if isinstance(value, (list, tuple)):
+        return tuple(hashable(v) for v in value)
+    return value
+
+class CombinationSpace:
+    """The cartesian product of some dimensions, generated on demand.
+
+    Combination i is the mixed-radix number i whose digits are positions in
+    the dimensions, the last dimension varying fastest, so the order is that
+    of itertools.product(). Indexing maps an index to its combination and
+    index() maps a combination back. Slicing with a step of 1 gives a view
+    of a contiguous range of the same space without generating anything.
+    """
+
+    def __init__(self, *dimensions):
+        self.dimensions = [list(d) for d in dimensions]
+        self.positions = [{hashable(v): p for p, v in enumerate(d)} for d in self.dimensions]
+        # weights[d]: combinations per step of dimension d
+        self.weights = [1] * len(self.dimensions)
+        for d in range(len(self.dimensions) - 2, -1, -1):
+            self.weights[d] = self.weights[d + 1] * len(self.dimensions[d + 1])
+        self.size = self.weights[0] * len(self.dimensions[0]) if self.dimensions else 0
+        self.start = 0
+        self.stop = self.size
+
+    def __len__(self):
+        return self.stop - self.start
+
+    def __getitem__(self, i):
+        if isinstance(i, slice):
+            start, stop, step = i.indices(len(self))
+            if step != 1:
+                raise ValueError("combination space slices must be contiguous")
+            view = copy.copy(self)
+            view.start = self.start + start
+            view.stop = self.start + max(start, stop)
+            return view
+        if i < 0:
+            i += len(self)
+        if not 0 <= i < len(self):
+            raise IndexError("combination index out of range")
+        return self.combination(self.start + i)
+
+    def combination(self, index):
+        """The combination at `index` of the whole space."""
+        return tuple(d[(index // w) % len(d)] for d, w in zip(self.dimensions, self.weights))
+
+    def index(self, combination):
+        """The index of `combination` in the whole space; ValueError if it is not part of it."""
+        try:
+            return sum(p[hashable(v)] * w for p, v, w in zip(self.positions, combination, self.weights))
+        except KeyError:
+            raise ValueError("combination not in space") from None
+
+    def __iter__(self):
+        if not len(self):
+            return
+        digits = [(self.start // w) % len(d) for d, w in zip(self.dimensions, self.weights)]
+        for _ in range(len(self)):
+            yield tuple(d[p] for d, p in zip(self.dimensions, digits))
+            # Odometer step
+            for d in range(len(digits) - 1, -1, -1):
+                digits[d] += 1
+                if digits[d] < len(self.dimensions[d]):
+                    break
+                digits[d] = 0
+
+class ScheduledCombinations:
+    """Combinations in the order a run visits them: `first`, then the rest in ascending order.
+
+    `first` holds positions in `combinations`. Position p of the run is
+    index_at(p); the rest is never materialised, only the positions of
+    `first` are kept, sorted, to count those skipped below a position.
+    Slicing with a step of 1 gives a view of a contiguous range of the run.
+    """
+
+    def __init__(self, combinations, first):
+        self.combinations = combinations
+        self.first = first
+        # gaps[k]: positions of the rest below the k-th smallest of `first`
+        self.gaps = [position - k for k, position in enumerate(sorted(first))]
+        self.start = 0
+        self.stop = len(combinations)
+
+    def __len__(self):
+        return self.stop - self.start
+
+    def __getitem__(self, i):
+        if isinstance(i, slice):
+            start, stop, step = i.indices(len(self))
+            if step != 1:
+                raise ValueError("scheduled combination slices must be contiguous")
+            view = copy.copy(self)
+            view.start = self.start + start
+            view.stop = self.start + max(start, stop)
+            return view
+        if i < 0:
+            i += len(self)
+        if not 0 <= i < len(self):
+            raise IndexError("combination index out of range")
+        return self.combinations[self.index_at(self.start + i)]
+
+    def index_at(self, position):
+        """The position in `combinations` visited at `position` of the whole run."""
+        if position < len(self.first):
+            return self.first[position]
+        rank = position - len(self.first)
+        return rank + bisect.bisect_right(self.gaps, rank)
+
+    def __iter__(self):
+        for position in range(self.start, self.stop):
+            yield self.combinations[self.index_at(position)]
+
+def schedule_failures_first(combinations, histories):
+    """The combinations with a history in any of `histories` first, then the rest in their order.
+
+    The combinations of the histories are looked up by index, so scheduling
+    costs time and memory per history entry, not per combination. The
+    first part is in at most 2 * HISTORY_RUNS tiers of
+    FailureHistory.priority(), each in ascending order, so that the results log of the run stays a merge of
+    few ascending runs (see read_results_log_in_order()). Returns the
+    scheduled combinations and the number of those with a history.
+    """
+    if isinstance(combinations, CombinationSpace):
+        def position(combination):
+            try:
+                index = combinations.index(combination) - combinations.start
+            except ValueError:
+                return None
+            return index if 0 <= index < len(combinations) else None
+    else:
+        # A plan, which is in memory anyway
+        positions = {format_key_combo(*c): p for p, c in enumerate(combinations)}
+        position = lambda combination: positions.get(format_key_combo(*combination))
+    priorities = {}
+    for history in histories:
+        for combo, entry in history.entries.items():
+            p = position(entry['combination'])
+            if p is not None:
+                priority = history.priority(combo)
+                priorities[p] = min(priorities.get(p, priority), priority)
+    first = sorted(priorities, key=lambda p: (priorities[p], p))
+    return ScheduledCombinations(combinations, first), len(first)
+
+def make_plan(keys, strength):
+    """A t-wise covering array of the combination matrix, as combinations ordered by key.
+
+    The modifiers, locks and kitty flags bits are binary factors each, so
+    the plan covers every t-tuple of flag bits, not of flags values. Returns
+    the combinations and the number of interactions they cover.
+    """
+    levels = [len(keys)] + [2] * (len(MODIFIERS) + len(LOCKS) + KITTY_FLAG_BITS)
+    rows = sorted(set(map(tuple, covering_array(levels, strength))))
+    missing, interactions = uncovered_interactions(rows, levels, strength)
+    if missing:
+        raise AssertionError(f"covering array misses {missing} interactions")
+    plan = []
+    for key, *bits in rows:
+        mods = [m for m, bit in zip(MODIFIERS, bits) if bit]
+        locks = [l for l, bit in zip(LOCKS, bits[len(MODIFIERS):]) if bit]
+        flags = sum(bit << b for b, bit in enumerate(bits[len(MODIFIERS) + len(LOCKS):]))
+        plan.append((keys[key], mods, locks, flags))
+    return plan, interactions
+
+def write_plan(path, plan, strength):
+    # JSON Lines: a header, then one [key, mods, locks, flags] per combination
+    with open(path, 'w', encoding='utf-8') as f:
+        f.write(json.dumps({'plan': {'strength': strength, 'combinations': len(plan)}}) + "\n")
+        for combination in plan:
+            f.write(json.dumps(combination) + "\n")
+
+def read_plan(path):
+    with open(path, encoding='utf-8') as f:
+        header = json.loads(f.readline())['plan']
+        plan = [tuple(json.loads(line)) for line in f if line.strip()]
+    if len(plan) != header['combinations'] or any(len(c) != 4 for c in plan):
+        raise ValueError("truncated or malformed plan")
+    return plan
+
+def chunked(items, size, start=0):
+    # With `start`, the index of items[0] in the full list, chunk boundaries
+    # fall on multiples of `size` in the full list. Chunks are lists, also
+    # when `items` is a CombinationSpace.
+    offset = 0
+    end = size - start % size
+    while offset < len(items):
+        yield offset, list(items[offset:end])
+        offset, end = end, end + size
+
+class FlagCollapser:
+    """Runs only one kitty flags value per equivalence class of every key/modifier/lock cell.
+
+    A cell is probed at flags 0 and 31 and with every single flag bit
+    toggled from either. A bit influences an encoder in that cell if any
+    toggle of it changes the encoder's output. Kitty and the target are
+    analysed separately: flags values that agree in the bits influencing an
+    encoder form a class, only the class representative (other bits
+    cleared) is run, and the other members copy its output. Probes that are
+    not representatives double as a check: if one of them disagrees with its
+    representative, the bits interact in a way the probes missed, and that
+    encoder runs the whole cell.
+    """
+
+    def __init__(self, flag_values):
+        self.flag_values = list(flag_values)
+        self.all_bits = max(self.flag_values)
+        self.bits = [1 << b for b in range(self.all_bits.bit_length())]
+        self.probes = sorted({0, self.all_bits} | set(self.bits) | {self.all_bits ^ bit for bit in self.bits})
+        self.total = 0
+        self.runs = [0, 0] # kitty, target
+        self.fallback_cells = 0
+
+    def influence_mask(self, outputs, cell):
+        mask = 0
+        for bit in self.bits:
+            if (outputs[cell[0]] != outputs[cell[bit]] or
+                    outputs[cell[self.all_bits]] != outputs[cell[self.all_bits ^ bit]]):
+                mask |= bit
+        return mask
+
+    def evaluate(self, chunk, kitty_fmts, target_fmts, run):
+        """Fills all outputs of `chunk`. `run(kitty_positions, target_positions)` runs each
+        tester for those of its positions whose output is None."""
+        sides = (kitty_fmts, target_fmts)
+
+        def run_missing(*positions):
+            todo = [[j for j in dict.fromkeys(p) if outputs[j] is None] for p, outputs in zip(positions, sides)]
+            for side, side_todo in enumerate(todo):
+                self.runs[side] += len(side_todo)
+            run(*todo)
+
+        # Cells cut by the ends of the matrix slice are run in full
+        cells = {}
+        for j, (key_info, mods, locks, flags) in enumerate(chunk):
+            cells.setdefault((id(key_info), tuple(mods), tuple(locks)), {})[flags] = j
+        complete = [cell for cell in cells.values() if len(cell) == len(self.flag_values)]
+        self.total += len(chunk)
+
+        first = [j for cell in cells.values() if len(cell) != len(self.flag_values) for j in cell.values()]
+        first += [cell[f] for cell in complete for f in self.probes]
+        run_missing(first, first)
+
+        masks = [[self.influence_mask(outputs, cell) for outputs in sides] for cell in complete]
+        run_missing(*([cell[f & cell_masks[side]] for cell, cell_masks in zip(complete, masks) for f in self.flag_values]
+                      for side in range(len(sides))))
+
+        fallback = ([], [])
+        for cell, cell_masks in zip(complete, masks):
+            failed = False
+            for side, outputs in enumerate(sides):
+                mask = cell_masks[side]
+                if any(outputs[cell[f]] != outputs[cell[f & mask]] for f in self.probes):
+                    fallback[side].extend(cell.values())
+                    failed = True
+                    continue
+                for f in self.flag_values:
+                    if outputs[cell[f]] is None:
+                        outputs[cell[f]] = outputs[cell[f & mask]]
+            self.fallback_cells += failed
+        run_missing(*fallback)
+
 def format_key_combo(key_info, mods, locks, flags):
     combo_parts = [m.replace('--', '') for m in mods + locks]
     combo_parts.append(key_info['name'])
     combo_str = "+".join(combo_parts)
+    if 'layout' in key_info:
+        return f"Key: {combo_str}, Flags: {flags}, Layout: {key_info['layout']}"
     return f"Key: {combo_str}, Flags: {flags}"
 
-def save_results(results, target_name):
-    mismatches = [r for r in results if r['status'] == 'mismatch']
+def classify(kitty_out, target_out, is_fallback):
+    if "[ERROR:" in kitty_out or "[ERROR:" in target_out:
+        return 'error'
+    if kitty_out == "[EMPTY]":
+        return 'skipped_kitty_empty'
+    if is_fallback(target_out):
+        return 'skipped_target_fallback'
+    return 'match' if kitty_out == target_out else 'mismatch'
 
-    with open(RESULTS_FILE, 'w') as f:
-        json_results = []
-        for r in results:
-            json_r = r.copy()
-            json_r['kitty_out_fmt'] = format_raw_output(json_r.pop('kitty_out'))
-            json_r['target_out_fmt'] = format_raw_output(json_r.pop('target_out'))
-            json_results.append(json_r)
-        json.dump(json_results, f, indent=2)
+def parse_targets(value):
+    # "all" or a comma-separated list of targets
+    names = list(TARGETS) if value == 'all' else [name.strip() for name in value.split(',') if name.strip()]
+    if not names or any(name not in TARGETS for name in names):
+        raise argparse.ArgumentTypeError(f"invalid target '{value}', expected all or a comma-separated list of {', '.join(TARGETS)}")
+    return list(dict.fromkeys(names))
 
-    with open(MISMATCH_LOG_FILE, 'w') as f:
-        f.write(f"Target: {target_name}\n")
-        f.write(f"Found {len(mismatches)} mismatches.\n\n")
+def parse_shard(value):
+    # "i/N" with 1 <= i <= N
+    try:
+        index, count = (int(part) for part in value.split('/'))
+    except ValueError:
+        raise argparse.ArgumentTypeError(f"invalid shard '{value}', expected i/N")
+    if count < 1 or not 1 <= index <= count:
+        raise argparse.ArgumentTypeError(f"invalid shard '{value}', expected 1 <= i <= N")
+    return index, count
+
+def shard_path(path, shard):
+    # test_results.json -> test_results.shard2of4.json
+    if not shard:
+        return path
+    root, ext = os.path.splitext(path)
+    return f"{root}.shard{shard[0]}of{shard[1]}{ext}"
+
+def target_path(path, target_name):
+    # test_results.json -> test_results.vte.json, in runs of several targets
+    root, ext = os.path.splitext(path)
+    return f"{root}.{target_name}{ext}"
+
+def shard_slice(total, shard):
+    # Contiguous, balanced slices: shard sizes differ by at most one
+    index, count = shard
+    return (total * (index - 1)) // count, (total * index) // count
+
+class ResultsLog:
+    """Append-only JSON Lines log of test outcomes. Every outcome is written once, in run order.
+
+    Outcomes carry the index of their combination, which orders the reports
+    of runs that did not visit the combinations in order. The first line is a header describing the run (see run_info()), which
+    --resume and --incremental check before trusting the outcomes below it.
+    """
+
+    def __init__(self, path, header):
+        self.path = path
+        self.file = open(path, 'w', encoding='utf-8')
+        self.file.write(json.dumps({'run': header}) + "\n")
+
+    @classmethod
+    def reopen(cls, path):
+        """Continues an existing log after its last complete outcome."""
+        log = cls.__new__(cls)
+        log.path = path
+        log.file = open(path, 'r+', encoding='utf-8')
+        # Cut off a torn last line, appending after it would corrupt the next outcome
+        end = 0
+        while line := log.file.readline():
+            if not line.endswith("\n"):
+                break
+            end = log.file.tell()
+        log.file.seek(end)
+        log.file.truncate()
+        return log
+
+    def append(self, index, combo, status, kitty_out_fmt, target_out_fmt):
+        record = {
+            'index': index,
+            'combo': combo,
+            'status': status,
+            'kitty_out_fmt': kitty_out_fmt,
+            'target_out_fmt': target_out_fmt,
+        }
+        self.file.write(json.dumps(record) + "\n")
+
+    def flush(self):
+        # Called after every batch, so a crash loses at most the batch in flight
+        self.file.flush()
+
+    def close(self):
+        self.file.flush()
+        os.fsync(self.file.fileno())
+        self.file.close()
+
+def read_results_log(path):
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            if not line.endswith("\n"):
+                break # A torn last line left behind by a crash
+            record = json.loads(line)
+            if 'run' not in record:
+                yield record
+
+def reusable_output(fmt):
+    # Errors may have been transient, and combinations that did not run have no output
+    return "[ERROR:" not in fmt and fmt != NOT_RUN_OUTPUT
+
+def read_results_log_in_order(path):
+    """The outcomes of a results log in combination order, without their index.
+
+    The log is made of ascending runs of indices, one unless the run was
+    scheduled (see schedule_failures_first()). They are found in a first
+    pass and merged from the file, one open file per run, so memory does
+    not depend on the size of the log.
+    """
+    runs = [] # [first byte, end byte] of every ascending run
+    previous = None
+    with open(path, 'rb') as f:
+        offset = 0
+        for line in f:
+            if not line.endswith(b"\n"):
+                break # A torn last line left behind by a crash
+            record = json.loads(line)
+            if 'run' not in record:
+                if previous is None or record['index'] < previous:
+                    runs.append([offset, offset])
+                previous = record['index']
+                runs[-1][1] = offset + len(line)
+            offset += len(line)
+
+    def read_run(first, end):
+        with open(path, 'rb') as f:
+            f.seek(first)
+            while first < end:
+                line = f.readline()
+                first += len(line)
+                record = json.loads(line)
+                yield record.pop('index'), record
+
+    for _, record in heapq.merge(*(read_run(first, end) for first, end in runs), key=lambda item: item[0]):
+        yield record
+
+def read_log_header(path):
+    try:
+        with open(path, encoding='utf-8') as f:
+            return json.loads(f.readline())['run']
+    except (OSError, ValueError, KeyError, TypeError):
+        return None
+
+def combinations_hash(combinations):
+    """Identifies the combinations of a run and their order.
+
+    Spaces and schedules are hashed by the parameters that generate them, so
+    this costs time per dimension value and history entry, not per combination.
+    """
+    matrix = hashlib.sha256()
+    if isinstance(combinations, ScheduledCombinations):
+        matrix.update(json.dumps({'schedule': combinations.first, 'start': combinations.start, 'stop': combinations.stop}).encode() + b"\n")
+        combinations = combinations.combinations
+    if isinstance(combinations, CombinationSpace):
+        for dimension in combinations.dimensions:
+            matrix.update(json.dumps(dimension, sort_keys=True).encode() + b"\n")
+        matrix.update(json.dumps({'start': combinations.start, 'stop': combinations.stop}).encode() + b"\n")
+    else:
+        # A plan, which is in memory anyway
+        for key_info, mods, locks, flags in combinations:
+            matrix.update(format_key_combo(key_info, mods, locks, flags).encode() + b"\n")
+    return matrix.hexdigest()[:32]
+
+def run_info(target_name, target_conf, combinations, history_run):
+    """Identifies the combinations of a run and the encoder sources that produced its outcomes.
+
+    `history_run` is the number the run has in the failure history, which
+    --resume carries over to the rest of the run.
+    """
+    return {
+        'target': target_name,
+        'combinations': len(combinations),
+        'matrix': combinations_hash(combinations),
+        'kitty_sources': hash_inputs(KITTY_CACHE_INPUTS),
+        'target_sources': hash_inputs(target_conf['inputs']),
+        'history_run': history_run,
+    }
+
+class FailureHistory:
+    """The combinations of a target that failed or changed status in recent runs.
+
+    Entries are keyed by format_key_combo() and hold the combination, whether
+    it failed (mismatch or error) when it last ran, and the run it last
+    changed status in, a first failure included. Failing combinations stay until
+    they pass; passing ones leave HISTORY_RUNS runs after their last change.
+    Combinations that always passed are never stored, so the file stays
+    small next to the matrix. Only complete runs are written, so runs that
+    were interrupted or covered part of the combinations do not age it.
+    """
+
+    FAILED = ('mismatch', 'error')
+
+    def __init__(self, path):
+        self.path = path
+        try:
+            with open(path, encoding='utf-8') as f:
+                history = json.load(f)
+            self.run = history['runs'] + 1
+            self.entries = {combo: entry for combo, entry in history['combinations'].items() if 'combination' in entry}
+        except (OSError, ValueError, KeyError, TypeError, AttributeError):
+            self.run, self.entries = 1, {}
+
+    def priority(self, combo):
+        """Sort key of a combination for --failures-first, None if it has no history.
+
+        Failing combinations come first, then recently fixed ones, the most
+        recent change first within each. Every entry changed in an earlier
+        run, 1 to HISTORY_RUNS runs ago for passing ones, and failing ones
+        that changed longer ago share the last tier, so there are at most
+        2 * HISTORY_RUNS tiers.
+        """
+        entry = self.entries.get(combo)
+        if entry is None:
+            return None
+        return (not entry['failing'], min(self.run - entry['changed'], HISTORY_RUNS))
+
+    def add(self, combination, combo, status):
+        """Records the status of a combination that ran in this run."""
+        failing = status in self.FAILED
+        entry = self.entries.get(combo)
+        if entry is None:
+            if failing:
+                self.entries[combo] = {'combination': combination, 'failing': True, 'changed': self.run}
+        elif entry['failing'] != failing:
+            entry['failing'] = failing
+            entry['changed'] = self.run
+
+    def write(self):
+        entries = {combo: entry for combo, entry in self.entries.items()
+                   if entry['failing'] or self.run - entry['changed'] < HISTORY_RUNS}
+        with open(self.path, 'w', encoding='utf-8') as f:
+            # One combination per line
+            f.write(f'{{"runs": {self.run}, "combinations": {{')
+            f.write(",".join(f"\n  {json.dumps(combo)}: {json.dumps(entry)}" for combo, entry in entries.items()))
+            f.write("\n}}\n")
+
+class OutcomeMatrix:
+    """The status of every combination of a run, packed into 3 bits each and indexed by combination number.
+
+    Only mismatches and errors keep their combination and outputs, so memory
+    is that of the matrix, a few hundred KB for millions of combinations,
+    plus the failures. Everything else of an outcome is in the results log.
+    """
+
+    STATUSES = (None, 'match', 'mismatch', 'error', 'skipped_kitty_empty', 'skipped_target_fallback', 'skipped_key_failing')
+    CODES = {status: code for code, status in enumerate(STATUSES)}
+    BITS = 3
+    KEPT = ('mismatch', 'error')
+
+    def __init__(self, size):
+        self.size = size
+        # One spare byte, so that every code lies within two bytes
+        self.bits = bytearray((size * self.BITS + 7) // 8 + 1)
+        self.counts = defaultdict(int)
+        self.failures = [] # (index, combo, status, kitty_out_fmt, target_out_fmt) in run order
+        self.failure_masks = {}
+
+    def add(self, index, combo, status, kitty_out_fmt, target_out_fmt):
+        offset = index * self.BITS
+        byte, shift = offset >> 3, offset & 7
+        word = (self.bits[byte] | self.bits[byte + 1] << 8) & ~(7 << shift) | self.CODES[status] << shift
+        self.bits[byte] = word & 0xff
+        self.bits[byte + 1] = word >> 8
+        self.counts[status] += 1
+        if status in self.KEPT:
+            self.failures.append((index, combo, status, kitty_out_fmt, target_out_fmt))
+
+    def mismatches(self):
+        # In combination order, whatever order they ran in
+        self.failures.sort(key=lambda failure: failure[0])
+        for _, combo, status, kitty_out_fmt, target_out_fmt in self.failures:
+            if status == 'mismatch':
+                yield {'combo': combo, 'status': status, 'kitty_out_fmt': kitty_out_fmt, 'target_out_fmt': target_out_fmt}
 
-        max_combo_len = 0
-        max_kitty_len = 0
-        if mismatches:
-            max_combo_len = max(len(r['combo']) for r in mismatches)
-            max_kitty_len = max(len(format_raw_output(r['kitty_out'])) for r in mismatches)
+    def block_results(self, starts):
+        """(tested, passed) numbers of the blocks of consecutive combinations beginning at `starts`.
 
+        With the combinations ordered by key, the blocks are the keys. A
+        block is tested if any of its combinations ran and passed if all of
+        those matched.
+        """
+        tested = passed = 0
+        ends = list(starts[1:]) + [self.size]
+        for start, end in zip(starts, ends):
+            count = end - start
+            first = start * self.BITS
+            codes = int.from_bytes(self.bits[first >> 3:((first + count * self.BITS + 7) >> 3)], 'little')
+            codes = (codes >> (first & 7)) & ((1 << (count * self.BITS)) - 1)
+            if not codes:
+                continue
+            tested += 1
+            # Not run (0) and match (1) leave the two high bits of a code clear,
+            # not run because the key already failed (6) does not
+            if count not in self.failure_masks:
+                self.failure_masks[count] = int('110' * count, 2)
+            passed += not codes & self.failure_masks[count]
+        return tested, passed
+
+class MismatchClusters:
+    """Groups mismatches by root cause, in one pass over the results and in bounded memory.
+
+    Mismatches belong to the same cluster when their outputs have the same
+    shape: numbers abstracted to '#', or '=' where both sides agree, and
+    text outside escape sequences abstracted to '*'. A cluster then only
+    keeps the values it has seen of every dimension of the matrix, so its
+    description names what varies within it ("any mods") and what does not
+    ("ctrl"), and its first mismatch as the reproducer.
+    """
+
+    MAX_CLUSTERS = 1000 # Further shapes all go into one last cluster
+    MAX_KEY_RUNS = 8 # Key ranges listed per cluster
+    MOD_NAMES = ('shift', 'ctrl', 'alt', 'caps', 'num')
+    LOCK_NAMES = ('caps', 'num')
+    COMBO = re.compile(r'Key: (.*), Flags: (\d+)(?:, Layout: (.*))?$')
+    TOKEN = re.compile(r'ESC\[[0-9;:]*.?|ESC.?|\\[0rtb]|.', re.DOTALL)
+    NUMBER = re.compile(r'\d+')
+
+    class Cluster:
+        def __init__(self, record, shape):
+            self.shape = shape
+            self.record = record # The reproducer
+            self.count = 0
+            self.kitty_varies = self.target_varies = False
+            self.keys = 0
+            self.last_key = 0 # Ordinal
+            self.key_runs = [] # [first ordinal, first name, last ordinal, last name]
+            self.mods = set()
+            self.locks = set()
+            self.flags = set()
+
+    def __init__(self):
+        self.clusters = {}
+        self.overflow = None
+        self.mismatches = 0
+        # What the whole run covers, to tell "any" apart from a subset
+        self.keys = 0
+        self.last_key = None
+        self.mods = {} # Used as ordered sets
+        self.locks = {}
+        self.flags = set()
+
+    @classmethod
+    def parse_combo(cls, combo):
+        """Splits format_key_combo() output into (key, mods, locks, flags)."""
+        match = cls.COMBO.match(combo)
+        key, flags, layout = match.groups()
+        mods, locks = [], []
+        while True:
+            name = next((n for n in cls.MOD_NAMES if key.startswith(n + '+') and len(key) > len(n) + 1), None)
+            if not name:
+                break
+            (locks if name in cls.LOCK_NAMES else mods).append(name)
+            key = key[len(name) + 1:]
+        if layout is not None:
+            key = f"{key}/{layout}"
+        return key, '+'.join(mods), '+'.join(locks), int(flags)
+
+    @classmethod
+    def output_shape(cls, text):
+        if text.startswith('['):
+            return text # [EMPTY]
+        parts = []
+        for token in cls.TOKEN.findall(text):
+            if token.startswith('ESC['):
+                parts.append(cls.NUMBER.sub('#', token))
+            elif token.startswith('ESC'):
+                parts.append(token if token in ('ESC', 'ESCO') else 'ESC*')
+            elif token.startswith('\\') and len(token) == 2:
+                parts.append(token)
+            elif not parts or parts[-1] != '*':
+                parts.append('*')
+        return ''.join(parts)
+
+    @classmethod
+    def shape(cls, kitty_out, target_out):
+        kitty_shape, target_shape = cls.output_shape(kitty_out), cls.output_shape(target_out)
+        if kitty_shape == target_shape:
+            # Same sequence on both sides: tell the numbers that differ from those that agree
+            kitty_numbers = cls.NUMBER.findall(kitty_out)
+            target_numbers = cls.NUMBER.findall(target_out)
+            if len(kitty_numbers) == len(target_numbers) == kitty_shape.count('#'):
+                same = iter(['=' if k == t else '#' for k, t in zip(kitty_numbers, target_numbers)])
+                kitty_shape = target_shape = re.sub('#', lambda m: next(same), kitty_shape)
+        return kitty_shape, target_shape
+
+    def add(self, record):
+        """Takes every record of the run in order, mismatching or not."""
+        key, mods, locks, flags = self.parse_combo(record['combo'])
+        if key != self.last_key:
+            # Results come key by key, so ordinals of consecutive keys are consecutive
+            self.keys += 1
+            self.last_key = key
+        self.mods[mods] = None
+        self.locks[locks] = None
+        self.flags.add(flags)
+        if record['status'] != 'mismatch':
+            return
+        self.mismatches += 1
+
+        shape = self.shape(record['kitty_out_fmt'], record['target_out_fmt'])
+        cluster = self.clusters.get(shape)
+        if cluster is None:
+            if len(self.clusters) < self.MAX_CLUSTERS:
+                cluster = self.clusters[shape] = self.Cluster(record, shape)
+            else:
+                if self.overflow is None:
+                    self.overflow = self.Cluster(record, None)
+                cluster = self.overflow
+
+        cluster.count += 1
+        cluster.kitty_varies |= record['kitty_out_fmt'] != cluster.record['kitty_out_fmt']
+        cluster.target_varies |= record['target_out_fmt'] != cluster.record['target_out_fmt']
+        runs = cluster.key_runs
+        if cluster.last_key != self.keys:
+            cluster.keys += 1
+            cluster.last_key = self.keys
+            if runs and runs[-1][2] == self.keys - 1:
+                runs[-1][2:] = [self.keys, key]
+            elif len(runs) < self.MAX_KEY_RUNS:
+                runs.append([self.keys, key, self.keys, key])
+        cluster.mods.add(mods)
+        cluster.locks.add(locks)
+        cluster.flags.add(flags)
+
+    @staticmethod
+    def describe_set(seen, universe, none, any_):
+        # In the order the run met the values
+        if seen == universe.keys() and len(universe) > 1:
+            return any_
+        missing = [value or none for value in universe if value not in seen]
+        if len(missing) < len(seen) - 1:
+            return f"{any_} except {'|'.join(missing)}"
+        return "|".join(value or none for value in universe if value in seen)
+
+    def describe_keys(self, cluster):
+        if cluster.keys == self.keys and len(cluster.key_runs) == 1:
+            return "any key"
+        ranges = [first if first_ord == last_ord else f"{first}..{last}"
+                  for first_ord, first, last_ord, last in cluster.key_runs]
+        listed = sum(last_ord - first_ord + 1 for first_ord, _, last_ord, _ in cluster.key_runs)
+        if cluster.keys > listed:
+            ranges.append(f"+{cluster.keys - listed} more")
+        return "Key " + ", ".join(ranges)
+
+    def describe_flags(self, seen):
+        if seen == self.flags and len(seen) > 1:
+            return "any flags"
+        if len(seen) == 1:
+            return f"flags {next(iter(seen))}"
+        # The flag bits all values have in common, if they are all values with those bits
+        bits = 1
+        for value in self.flags:
+            while bits <= value:
+                bits <<= 1
+        set_bits = clear_bits = bits - 1
+        for value in seen:
+            set_bits &= value
+            clear_bits &= ~value
+        if (set_bits or clear_bits) and seen == {v for v in self.flags if v & set_bits == set_bits and not v & clear_bits}:
+            terms = []
+            if set_bits:
+                terms.append("with " + "+".join(str(1 << b) for b in range(bits.bit_length()) if set_bits >> b & 1))
+            if clear_bits:
+                terms.append("without " + "+".join(str(1 << b) for b in range(bits.bit_length()) if clear_bits >> b & 1))
+            return "any flags " + ", ".join(terms)
+        missing = sorted(self.flags - seen)
+        if len(missing) <= 2:
+            return "any flags except " + ",".join(map(str, missing))
+        # Otherwise as ranges of values
+        values = sorted(seen)
+        ranges = []
+        for value in values:
+            if ranges and ranges[-1][1] == value - 1:
+                ranges[-1][1] = value
+            else:
+                ranges.append([value, value])
+        return "flags " + ",".join(str(a) if a == b else f"{a}-{b}" for a, b in ranges)
+
+    def describe(self, cluster):
+        return " x ".join([
+            self.describe_keys(cluster),
+            self.describe_set(cluster.mods, self.mods, "no mods", "any mods"),
+            self.describe_set(cluster.locks, self.locks, "no locks", "any locks"),
+            self.describe_flags(cluster.flags),
+        ])
+
+    def write(self, path, target_name):
+        clusters = sorted(self.clusters.values(), key=lambda c: -c.count) # Stable: ties in run order
+        if self.overflow:
+            clusters.append(self.overflow)
+        with open(path, 'w', encoding='utf-8') as f:
+            f.write(f"Target: {target_name}\n")
+            f.write(f"Found {self.mismatches} mismatches in {len(clusters)} clusters.\n\n")
+            width = max((len(str(c.count)) for c in clusters), default=0)
+            for cluster in clusters:
+                record = cluster.record
+                if cluster.shape is None:
+                    outputs = "other outputs"
+                else:
+                    kitty_out = cluster.shape[0] if cluster.kitty_varies else record['kitty_out_fmt']
+                    target_out = cluster.shape[1] if cluster.target_varies else record['target_out_fmt']
+                    outputs = f"kitty {kitty_out} vs {target_name} {target_out}"
+                f.write(f"{cluster.count:>{width}}  {self.describe(cluster)} -> {outputs}"
+                        f"  (e.g. {record['combo']} -> kitty: {record['kitty_out_fmt']} | {target_name}: {record['target_out_fmt']})\n")
+
+def write_report(records, target_name, results_file, log_file, clusters_file, mismatches=None):
+    # `records` returns a fresh iterator over the results in run order. Unless
+    # `mismatches` iterates over the mismatches alone, e.g. those kept by an
+    # OutcomeMatrix, it is consumed twice, so memory use does not depend on
+    # the number of results.
+    mismatch_count = 0
+    max_combo_len = 0
+    max_kitty_len = 0
+    clusters = MismatchClusters()
+
+    with open(results_file, 'w') as f:
+        # Same bytes as json.dump(results, f, indent=2), one result at a time
+        first = True
+        for r in records():
+            f.write("[\n" if first else ",\n")
+            f.write(textwrap.indent(json.dumps(r, indent=2), "  "))
+            first = False
+            clusters.add(r)
+            if r['status'] == 'mismatch':
+                mismatch_count += 1
+                max_combo_len = max(max_combo_len, len(r['combo']))
+                max_kitty_len = max(max_kitty_len, len(r['kitty_out_fmt']))
+        f.write("[]" if first else "\n]")
+    clusters.write(clusters_file, target_name)
+
+    with open(log_file, 'w') as f:
+        f.write(f"Target: {target_name}\n")
+        f.write(f"Found {mismatch_count} mismatches.\n\n")
+
+        if not mismatch_count:
+            return
+        if mismatches is None:
+            mismatches = (r for r in records() if r['status'] == 'mismatch')
         for item in mismatches:
             combo_str = item['combo'].ljust(max_combo_len)
-            kitty_str = format_raw_output(item['kitty_out']).ljust(max_kitty_len)
-            tgt_str = format_raw_output(item['target_out'])
+            kitty_str = item['kitty_out_fmt'].ljust(max_kitty_len)
+            tgt_str = item['target_out_fmt']
             f.write(f"{combo_str} -> kitty: {kitty_str} | {target_name}: {tgt_str}\n")
 
+def save_results(target_name, outcomes, path):
+    # `path` maps an output file name to that of the target and shard
+    log_path = path(RESULTS_LOG_FILE)
+    write_report(lambda: read_results_log_in_order(log_path), target_name,
+                 path(RESULTS_FILE), path(MISMATCH_LOG_FILE), path(MISMATCH_CLUSTERS_FILE), outcomes.mismatches())
+
+class TargetRun:
+    """One target of a run: its tester, results log and outcomes, and its outputs of the current chunk."""
+
+    def __init__(self, name, target_names, shard, combinations):
+        self.name = name
+        self.conf = TARGETS[name]
+        self.multi = len(target_names) > 1
+        self.shard = shard
+        self.outcomes = OutcomeMatrix(combinations)
+        self.tester = None
+        self.results_log = None
+        self.previous = None # Outcomes of the run --incremental reuses
+        self.reuse = False
+        self.coverage_args = []
+        self.fmts = []
+        self.covs = []
+        self.failures = [] # (position, combo, status) of the chunk, with --trace
+        self.history = None
+        self.key_mismatches = defaultdict(int) # Key number -> mismatches, with --stop-key-after
+
+    def path(self, path):
+        return shard_path(target_path(path, self.name) if self.multi else path, self.shard)
+
+    def args(self, combos, extra_args=()):
+        return [self.conf['args_builder'](build_base_cmd(k, m, l), k, f) + list(extra_args) for k, m, l, f in combos]
+
+class CrossTargetMatrix:
+    """Compares the outcomes of several targets over the same combinations.
+
+    Counts the combinations that fail (mismatch or error) in one target and
+    match in another, for every pair of targets, and groups the combinations
+    by their statuses in all targets. The combinations that fail somewhere
+    and match elsewhere are listed in full; they are spooled to a temporary
+    file as they come, so memory does not grow with the run.
+    """
+
+    FAILED = ('mismatch', 'error')
+
+    def __init__(self, target_names):
+        self.target_names = target_names
+        self.combinations = 0
+        self.patterns = {} # Statuses in every target -> [count, first combination]
+        self.divergent = tempfile.TemporaryFile('w+', encoding='utf-8')
+        self.divergent_count = 0
+
+    def add(self, combo, statuses):
+        statuses = tuple(statuses)
+        self.combinations += 1
+        self.patterns.setdefault(statuses, [0, combo])[0] += 1
+        if 'match' in statuses and any(status in self.FAILED for status in statuses):
+            self.divergent_count += 1
+            self.divergent.write(f"{combo} -> " + " | ".join(f"{name}: {status}" for name, status in zip(self.target_names, statuses)) + "\n")
+
+    def write(self, path):
+        names = self.target_names
+        fails = [[0] * len(names) for _ in names]
+        for statuses, (count, _) in self.patterns.items():
+            for a, status_a in enumerate(statuses):
+                if status_a in self.FAILED:
+                    for b, status_b in enumerate(statuses):
+                        if status_b == 'match':
+                            fails[a][b] += count
+        width = max([len(name) for name in names] + [len(str(count)) for row in fails for count in row])
+
+        with open(path, 'w', encoding='utf-8') as f:
+            f.write(f"Targets: {', '.join(names)}\n")
+            f.write(f"Compared {self.combinations} combinations, {self.divergent_count} fail in some targets and match in others.\n\n")
+            f.write("Failing in the row target, matching in the column target:\n")
+            f.write(" " * width + "".join(f"  {name:>{width}}" for name in names) + "\n")
+            for a, name in enumerate(names):
+                f.write(f"{name:<{width}}" + "".join(f"  {'-' if a == b else count:>{width}}" for b, count in enumerate(fails[a])) + "\n")
+
+            patterns = sorted(self.patterns.items(), key=lambda p: -p[1][0]) # Stable: ties in run order
+            count_width = max((len(str(count)) for count, _ in self.patterns.values()), default=0)
+            f.write(f"\nStatuses in {' | '.join(names)}, most common first:\n")
+            for statuses, (count, combo) in patterns:
+                f.write(f"{count:>{count_width}}  {' | '.join(statuses)}  (e.g. {combo})\n")
+
+            f.write("\nFailing in some targets and matching in others:\n")
+            self.divergent.seek(0)
+            shutil.copyfileobj(self.divergent, f)
+        self.divergent.close()
+
+def format_duration(seconds):
+    minutes, seconds = divmod(int(seconds), 60)
+    return f"{minutes // 60}:{minutes % 60:02}:{seconds:02}" if minutes >= 60 else f"{minutes}:{seconds:02}"
+
+class LatencyHistogram:
+    """Request latencies in log-linear buckets of whole microseconds.
+
+    Every power of two is split into SUB_BUCKETS buckets, so a percentile read
+    from the buckets is off by at most 1/SUB_BUCKETS of its value, and the
+    power-of-two histogram of the profile is exact. Memory is fixed however
+    many requests a run makes.
+    """
+
+    SUB_BUCKETS = 8
+    BUCKETS = SUB_BUCKETS * 40 # Up to 2^40 us
+
+    def __init__(self):
+        self.counts = [0] * self.BUCKETS
+        self.count = 0
+        self.total = 0.0
+        self.max = 0.0
+
+    @classmethod
+    def bucket(cls, us):
+        # Below 2 * SUB_BUCKETS every microsecond has its own bucket
+        shift = max(0, us.bit_length() - cls.SUB_BUCKETS.bit_length())
+        return min(cls.BUCKETS - 1, shift * cls.SUB_BUCKETS + (us >> shift))
+
+    @classmethod
+    def lower_bound(cls, bucket):
+        if bucket < 2 * cls.SUB_BUCKETS:
+            return bucket
+        shift = bucket // cls.SUB_BUCKETS - 1
+        return (bucket - shift * cls.SUB_BUCKETS) << shift
+
+    def add(self, latencies):
+        for latency in latencies:
+            self.counts[self.bucket(int(latency * 1e6))] += 1
+            self.total += latency
+            self.max = max(self.max, latency)
+        self.count += len(latencies)
+
+    def percentile(self, fraction):
+        """Nearest-rank percentile in us, the middle of its bucket but at most the maximum."""
+        rank = min(self.count, max(1, int(self.count * fraction + 0.5)))
+        seen = 0
+        for bucket, count in enumerate(self.counts):
+            seen += count
+            if seen >= rank:
+                middle = (self.lower_bound(bucket) + self.lower_bound(bucket + 1)) / 2
+                return min(middle, self.max * 1e6)
+        return self.max * 1e6
+
+    def powers_of_two(self):
+        """Requests per power-of-two bucket, keyed by its (exclusive) upper bound in us."""
+        histogram = defaultdict(int)
+        for bucket, count in enumerate(self.counts):
+            if count:
+                histogram[1 << self.lower_bound(bucket).bit_length()] += count
+        return sorted(histogram.items())
+
+class RunProfile:
+    """Where the wall time of a run goes.
+
+    Phases are exclusive: entering a phase pauses the enclosing one, so the
+    phase times add up to the run time. Also keeps a latency histogram per
+    tester and the combinations/sec at every progress line.
+    """
+
+    RATE_WINDOW = 10 # Progress samples the live rate is averaged over
+
+    def __init__(self):
+        self.start = time.perf_counter()
+        self.phases = defaultdict(float)
+        self.current = None
+        self.since = self.start
+        self.latencies = defaultdict(LatencyHistogram)
+        self.samples = [] # (seconds since start, combinations done)
+
+    @contextmanager
+    def phase(self, name):
+        now = time.perf_counter()
+        if self.current:
+            self.phases[self.current] += now - self.since
+        outer, self.current, self.since = self.current, name, now
+        try:
+            yield
+        finally:
+            now = time.perf_counter()
+            self.phases[name] += now - self.since
+            self.current, self.since = outer, now
+
+    def add_latencies(self, tester_name, latencies):
+        self.latencies[tester_name].add(latencies)
+
+    def progress(self, done):
+        """Records a progress sample, returns the recent and the overall combinations/sec."""
+        elapsed = time.perf_counter() - self.start
+        self.samples.append((elapsed, done))
+        points = [(0.0, 0)] + self.samples
+        since, done_before = points[max(0, len(points) - 1 - self.RATE_WINDOW)]
+        recent = (done - done_before) / (elapsed - since) if elapsed > since else 0.0
+        return recent, done / elapsed if elapsed else 0.0
+
+    def summary(self, testers, combinations):
+        elapsed = time.perf_counter() - self.start
+        phases = dict(sorted(self.phases.items(), key=lambda p: -p[1]))
+        phases['other'] = max(0.0, elapsed - sum(phases.values()))
+        tester_stats = {}
+        for name, tester in testers:
+            latencies = self.latencies[name]
+            stats = {'requests': latencies.count, 'spawns': tester.spawns, 'spawn_seconds': round(tester.spawn_seconds, 6)}
+            if latencies.count:
+                stats['latency_us'] = {
+                    'mean': round(latencies.total / latencies.count * 1e6, 1),
+                    'p50': round(latencies.percentile(0.50), 1),
+                    'p95': round(latencies.percentile(0.95), 1),
+                    'p99': round(latencies.percentile(0.99), 1),
+                    'max': round(latencies.max * 1e6, 1),
+                }
+                stats['histogram_us'] = {f"<{bound}": count for bound, count in latencies.powers_of_two()}
+            tester_stats[name] = stats
+        return {
+            'seconds': round(elapsed, 3),
+            'combinations': combinations,
+            'combinations_per_sec': round(combinations / elapsed, 1) if elapsed else 0.0,
+            'phases': {name: round(seconds, 3) for name, seconds in phases.items()},
+            'testers': tester_stats,
+            'throughput': [{'seconds': round(t, 3), 'done': done} for t, done in self.samples],
+        }
+
+class CoverageReport:
+    """Collects the branch bitmaps of the instrumented encoders (see common/kt_coverage.h) over a run."""
+
+    def __init__(self, sides):
+        # sides: (name, branch table) of every instrumented encoder
+        self.sides = []
+        for name, table_path in sides:
+            with open(table_path, encoding='utf-8') as f:
+                branches = [line.rstrip('\n').split('\t', 2) for line in f]
+            inc_path = table_path.removesuffix(".branches")
+            self.sides.append((name, inc_path, branches, bytearray(KT_COV_MAP_BYTES)))
+        self.combinations = 0
+        # Branch bitmaps of all encoders -> [first combination, number of combinations]
+        self.paths = {}
+
+    def add(self, combo, bitmaps):
+        self.combinations += 1
+        for (_, _, _, taken), bitmap in zip(self.sides, bitmaps):
+            if bitmap and bitmap != "-":
+                for i, byte in enumerate(bytes.fromhex(bitmap)):
+                    taken[i] |= byte
+        self.paths.setdefault(tuple(bitmaps), [combo, 0])[1] += 1
+
+    def write(self, path):
+        with open(path, 'w', encoding='utf-8') as f:
+            f.write(f"Branch coverage over {self.combinations} combinations\n")
+            for name, inc_path, branches, taken in self.sides:
+                missed = [(line, code) for branch_id, line, code in branches
+                          if not taken[int(branch_id) >> 3] & (1 << (int(branch_id) & 7))]
+                f.write(f"\n{name}: {len(branches) - len(missed)}/{len(branches)} branches taken\n")
+                for line, code in missed:
+                    f.write(f"  never taken: {inc_path}:{line}: {code}\n")
+
+            f.write(f"\nDistinct paths: {len(self.paths)} (combinations taking the same branches in every encoder)\n")
+            for combo, count in sorted(self.paths.values(), key=lambda p: -p[1]):
+                f.write(f"  {count:7} x {combo}\n")
+
+class TraceLog:
+    """Writes the trace records (see common/kt_trace.h) of the combinations that failed.
+
+    Same format as write_trace_log() in difftest/report.cc.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self.file = open(path, 'w', encoding='utf-8')
+        self.combinations = 0
+        self.traced = 0 # Combinations with records from at least one side
+
+    def add(self, combo, status, traces):
+        # traces: (side name, records or None) of every tester
+        self.combinations += 1
+        if any(records for _, records in traces):
+            self.traced += 1
+        self.file.write(f"{combo} ({status})\n")
+        for name, records in traces:
+            self.file.write(f"  [{name}]\n")
+            lines = records.splitlines() if records else ["(no trace records)"]
+            self.file.writelines(f"    {line}\n" for line in lines)
+
+    def close(self):
+        self.file.close()
+
+def merge_shards(count, golden_file=None, target_names=None):
+    shards = [(i, count) for i in range(1, count + 1)]
+
+    if golden_file:
+        with open(golden_file, 'w', encoding='utf-8') as out:
+            for shard in shards:
+                with open(shard_path(golden_file, shard), encoding='utf-8') as f:
+                    out.write(f.read())
+        print(f"Merged {count} golden shards into '{golden_file}'.")
+        return
+
+    if not target_names or len(target_names) == 1:
+        merge_target_shards(shards, lambda path: path)
+        return
+
+    # Runs of several targets: every target's files, then the cross-target
+    # matrix from their merged results, which are in the same order
+    streams = [merge_target_shards(shards, lambda path, name=name: target_path(path, name)) for name in target_names]
+    cross = CrossTargetMatrix(target_names)
+    for rows in zip(*(records() for records in streams)):
+        cross.add(rows[0]['combo'], [r['status'] for r in rows])
+    cross.write(CROSS_TARGET_FILE)
+    print(f"Cross-target matrix: '{CROSS_TARGET_FILE}'")
+
+def merge_target_shards(shards, path):
+    # `path` maps an output file name to that of the target. Returns a
+    # function iterating over the merged results.
+    target_names = set()
+    for shard in shards:
+        with open(shard_path(path(MISMATCH_LOG_FILE), shard)) as f:
+            target_names.add(f.readline().rstrip('\n').removeprefix("Target: "))
+    if len(target_names) != 1:
+        raise ValueError(f"shards were run against different targets: {', '.join(sorted(target_names))}")
+
+    def records():
+        # One shard in memory at a time
+        for shard in shards:
+            with open(shard_path(path(RESULTS_FILE), shard)) as f:
+                yield from json.load(f)
+
+    target_name = target_names.pop()
+    write_report(records, target_name, path(RESULTS_FILE), path(MISMATCH_LOG_FILE), path(MISMATCH_CLUSTERS_FILE))
+    total = mismatches = 0
+    for r in records():
+        total += 1
+        mismatches += r['status'] == 'mismatch'
+    print(f"Merged {len(shards)} shards for target {target_name}: {total} combinations, {mismatches} mismatches.")
+    print(f"Mismatch details: '{path(MISMATCH_LOG_FILE)}'")
+    print(f"Mismatch clusters: '{path(MISMATCH_CLUSTERS_FILE)}'")
+    print(f"Raw results: '{path(RESULTS_FILE)}'")
+    return records
+
 def main():
     parser = argparse.ArgumentParser(description="Test and compare kitty and other terminal key encoders.")
     parser.add_argument("--debug", action="store_true", help="Enable debug output for commands.")
     parser.add_argument("--limit", type=int, default=0, help="Limit the number of test combinations to run.")
     parser.add_argument("--start-at-percent", type=int, default=0, help="Start tests from a certain percentage (0-99).")
-    parser.add_argument("--target", default="vte", choices=TARGETS.keys(), help="Select the target implementation to test (default: vte).")
+    parser.add_argument("--target", dest="targets", type=parse_targets, default=['vte'], metavar="{" + ",".join(TARGETS) + ",all}",
+                        help="Select the target implementation to test (default: vte). 'all' or a comma-separated list tests several against one kitty reference.")
     parser.add_argument("--generate-golden", metavar="FILE", help="Generate a golden rules file with reference kitty output only, then exit.")
+    parser.add_argument("--unicode-sweep", action="store_true", help="Test every BMP codepoint with a case mapping and a sample of astral codepoints instead of the matrix keys.")
+    parser.add_argument("--make-plan", metavar="FILE", help="Write a plan covering every t-way interaction of keys, modifiers, locks and flag bits to FILE, then exit.")
+    parser.add_argument("--strength", type=int, default=2, help="Interaction strength t of --make-plan: 2 for pairwise, 3 for 3-wise (default: 2).")
+    parser.add_argument("--plan", metavar="FILE", help="Run the combinations of a plan written by --make-plan instead of the full matrix.")
+    parser.add_argument("--layout", default="us", help="Comma-separated xkb layouts to test, e.g. us,ru,de (default: us). Non-US layouts need the VTE tester.")
+    parser.add_argument("--no-stream", action="store_true", help="Spawn a tester process per combination instead of using --stream mode.")
+    parser.add_argument("--no-cache", action="store_true", help="Always run the kitty tester instead of reusing cached reference outputs.")
+    parser.add_argument("--shard", type=parse_shard, metavar="i/N", help="Run only the i-th of N equal slices of the combinations (1-based). Outputs get a .shard<i>of<N> suffix.")
+    parser.add_argument("--merge-shards", type=int, metavar="N", help="Merge the outputs of shards 1..N into a single report (or golden file with --generate-golden), then exit.")
+    parser.add_argument("--resume", action="store_true", help="Continue an interrupted run from its results log instead of starting over.")
+    parser.add_argument("--incremental", action="store_true", help="Reuse the outputs of the previous run for every side whose encoder sources did not change since.")
+    parser.add_argument("--collapse-flags", action="store_true", help="Run one kitty flags value per class of values that give the same output, found by probing every key/modifier cell.")
+    parser.add_argument("--failures-first", action="store_true", help="Run the combinations that failed or changed status in recent runs first, as recorded in failure_history.<target>.json.")
+    parser.add_argument("--stop-key-after", type=int, default=0, metavar="N", help="Stop testing a key once it has N mismatches; its remaining combinations are recorded as not run.")
+    parser.add_argument("--coverage", metavar="FILE", help="Record the branches every combination takes in the encoders built with 'make COVERAGE=1' and write a coverage report to FILE.")
+    parser.add_argument("--trace", metavar="FILE", help="Rerun every mismatch and error with tracing and write the trace records of the encoders built with 'make TRACE=1' to FILE.")
     args = parser.parse_args()
 
-    target_conf = TARGETS[args.target]
+    if args.merge_shards:
+        try:
+            merge_shards(args.merge_shards, args.generate_golden, args.targets)
+        except (OSError, ValueError) as e:
+            print(f"Error: Cannot merge shards: {e}", file=sys.stderr)
+            sys.exit(1)
+        return
+    if args.shard and args.start_at_percent:
+        print("Error: --shard and --start-at-percent cannot be combined.", file=sys.stderr)
+        sys.exit(1)
+    if args.resume and args.incremental:
+        print("Error: --resume and --incremental cannot be combined.", file=sys.stderr)
+        sys.exit(1)
+    if args.coverage and (args.resume or args.incremental or args.no_stream or args.collapse_flags):
+        print("Error: --coverage needs a complete run in --stream mode, without --resume, --incremental, --no-stream or --collapse-flags.", file=sys.stderr)
+        sys.exit(1)
+    if args.trace and args.no_stream:
+        print("Error: --trace needs --stream mode.", file=sys.stderr)
+        sys.exit(1)
+    if args.strength < 1:
+        print("Error: --strength must be at least 1.", file=sys.stderr)
+        sys.exit(1)
+    if args.plan and (args.make_plan or args.unicode_sweep or args.collapse_flags or args.layout != "us"):
+        print("Error: A --plan brings its own keys and cannot be combined with --make-plan, --unicode-sweep, --layout or --collapse-flags.", file=sys.stderr)
+        sys.exit(1)
+    if len(args.targets) > 1 and (args.resume or args.incremental or args.collapse_flags):
+        print("Error: --resume, --incremental and --collapse-flags need a single target.", file=sys.stderr)
+        sys.exit(1)
+    if args.failures_first and (args.resume or args.incremental or args.collapse_flags):
+        # The first two pair the previous results log with the combinations by
+        # position, the last needs whole key/modifier/lock cells in a chunk
+        print("Error: --failures-first cannot be combined with --resume, --incremental or --collapse-flags.", file=sys.stderr)
+        sys.exit(1)
+    if args.stop_key_after < 0 or (args.stop_key_after and args.collapse_flags):
+        print("Error: --stop-key-after needs a positive N and cannot be combined with --collapse-flags.", file=sys.stderr)
+        sys.exit(1)
+
     if not args.generate_golden:
         if not os.path.exists(KITTY_TESTER):
             print(f"Error: Kitty tester ({KITTY_TESTER}) not found. Run 'make' first.", file=sys.stderr)
             sys.exit(1)
-        if not os.path.exists(target_conf['binary']):
-            print(f"Error: Target tester ({target_conf['binary']}) not found. Run 'make' first.", file=sys.stderr)
-            sys.exit(1)
+        for name in args.targets:
+            if not os.path.exists(TARGETS[name]['binary']):
+                print(f"Error: Target tester ({TARGETS[name]['binary']}) not found. Run 'make' first.", file=sys.stderr)
+                sys.exit(1)
     else:
         if not os.path.exists(KITTY_TESTER):
             print(f"Error: Kitty tester ({KITTY_TESTER}) not found. Run 'make' first.", file=sys.stderr)
             sys.exit(1)
 
-    mods_to_test = [[]] + [list(c) for i in range(1, 4) for c in itertools.combinations(['--shift', '--ctrl', '--alt'], i)]
-    locks_to_test = [ [], ['--caps'], ['--num'], ['--caps', '--num'] ]
-    kitty_flags_to_test = range(32)
+    os.makedirs(KEYMAP_CACHE_DIR, exist_ok=True)
 
-    keys_to_test = list(key_map.values())
+    mods_to_test = [list(c) for i in range(len(MODIFIERS) + 1) for c in itertools.combinations(MODIFIERS, i)]
+    locks_to_test = [list(c) for i in range(len(LOCKS) + 1) for c in itertools.combinations(LOCKS, i)]
+    kitty_flags_to_test = range(1 << KITTY_FLAG_BITS)
 
-    all_combinations = list(itertools.product(keys_to_test, mods_to_test, locks_to_test, kitty_flags_to_test))
-    total_tests = len(all_combinations)
+    keys_to_test = list(MATRIX_KEYS)
+
+    layouts = [l.strip() for l in args.layout.split(',') if l.strip()]
+    extra_layouts = [l for l in layouts if l != 'us']
+    if args.unicode_sweep:
+        if extra_layouts:
+            print("Error: --unicode-sweep and --layout cannot be combined.", file=sys.stderr)
+            sys.exit(1)
+        keys_to_test = unicode_sweep_keys()
+        print(f"Unicode sweep: {len(keys_to_test)} codepoints (Unicode {unicodedata.unidata_version})")
+    if extra_layouts:
+        if not args.generate_golden and not all(TARGETS[name].get('supports_layouts') for name in args.targets):
+            print("Error: --layout is only supported for the vte target.", file=sys.stderr)
+            sys.exit(1)
+        vte_conf = TARGETS['vte']
+        if not os.path.exists(vte_conf['binary']):
+            print(f"Error: Non-US layouts are read through {vte_conf['binary']}. Run 'make' first.", file=sys.stderr)
+            sys.exit(1)
+        for layout in extra_layouts:
+            try:
+                layout_keys = load_layout_keys(layout, vte_conf)
+            except (subprocess.CalledProcessError, ValueError) as e:
+                print(f"Error: Cannot load layout '{layout}': {e}", file=sys.stderr)
+                sys.exit(1)
+            print(f"Layout {layout}: {len(layout_keys)} keys differ from us")
+            keys_to_test.extend(layout_keys)
+        if 'us' not in layouts:
+            keys_to_test = [k for k in keys_to_test if 'layout' in k]
+
+    if args.make_plan:
+        plan, interactions = make_plan(keys_to_test, args.strength)
+        try:
+            write_plan(args.make_plan, plan, args.strength)
+        except OSError as e:
+            print(f"Error: Cannot write plan: {e}", file=sys.stderr)
+            sys.exit(1)
+        full = len(keys_to_test) * len(mods_to_test) * len(locks_to_test) * len(kitty_flags_to_test)
+        print(f"Plan: {len(plan)} combinations instead of {full} cover all {interactions} "
+              f"{args.strength}-way interactions of the keys, modifiers, locks and kitty flags bits.")
+        print(f"Written to '{args.make_plan}'.")
+        return
+
+    if args.plan:
+        try:
+            all_combinations = read_plan(args.plan)
+        except (OSError, ValueError, KeyError, TypeError) as e:
+            print(f"Error: Cannot read plan '{args.plan}': {e}", file=sys.stderr)
+            sys.exit(1)
+        print(f"Plan: {len(all_combinations)} combinations from '{args.plan}'")
+    else:
+        # Generated lazily: slicing below only narrows the index range
+        all_combinations = CombinationSpace(keys_to_test, mods_to_test, locks_to_test, kitty_flags_to_test)
     if args.limit > 0:
         all_combinations = all_combinations[:args.limit]
-        total_tests = len(all_combinations)
+    total_tests = len(all_combinations)
+    # First combination of every key, for the per-key results
+    if args.plan:
+        key_starts = [i for i, c in enumerate(all_combinations) if i == 0 or c[0] != all_combinations[i - 1][0]]
+    else:
+        key_starts = range(0, total_tests, all_combinations.weights[0])
 
     start_index = 0
     if args.start_at_percent > 0:
@@ -210,135 +1776,352 @@ def main():
             start_index = (total_tests * args.start_at_percent) // 100
             all_combinations = all_combinations[start_index:]
             print(f"Starting at {args.start_at_percent}%, skipping first {start_index} combinations.")
+    elif args.shard:
+        start_index, end_index = shard_slice(total_tests, args.shard)
+        all_combinations = all_combinations[start_index:end_index]
+        print(f"Shard {args.shard[0]}/{args.shard[1]}: combinations {start_index}..{end_index - 1}.")
 
     if args.generate_golden:
-        print(f"Generating golden rules file: {args.generate_golden}")
+        golden_path = shard_path(args.generate_golden, args.shard)
+        print(f"Generating golden rules file: {golden_path}")
         print(f"Total combinations: {len(all_combinations)}")
 
+        kitty = make_kitty_tester(args)
         try:
-            with open(args.generate_golden, 'w', encoding='utf-8') as golden_file:
-                for i_offset, (key_info, mods, locks, flags) in enumerate(all_combinations):
-                    i = start_index + i_offset
-                    if i > 0 and i % 500 == 0:
-                        percent = ((i + 1) * 100) // total_tests
-                        print(f"Progress: {percent}% ({i}/{total_tests})", flush=True)
-
-                    base_cmd = ['--key', key_info['name']] + mods + locks
-                    kitty_cmd = [KITTY_TESTER] + base_cmd + ['--kitty-flags', str(flags)]
-                    if 'base_key' in key_info:
-                        kitty_cmd.extend(['--base-key', key_info['base_key']])
-
-                    kitty_out_raw = run_command(kitty_cmd, args.debug)
-                    kitty_out_fmt = format_raw_output(kitty_out_raw)
-
-                    # Reconstruct arg string for the file
-                    # Format: INPUT_ARGS | FLAGS | OUTPUT
-                    input_args_str = " ".join(base_cmd)
-                    if 'base_key' in key_info:
-                        input_args_str += f" --base-key {key_info['base_key']}"
-
-                    golden_file.write(f"{input_args_str} | {flags} | {kitty_out_fmt}\n")
-
-            print(f"Done. Golden rules saved to '{args.generate_golden}'.")
+            with open(golden_path, 'w', encoding='utf-8') as golden_file:
+                for chunk_offset, chunk in chunked(all_combinations, STREAM_BATCH):
+                    kitty.submit([build_kitty_args(build_base_cmd(k, m, l), k, f) for k, m, l, f in chunk])
+                    kitty_outs = kitty.collect()
+
+                    for j, (key_info, mods, locks, flags) in enumerate(chunk):
+                        i = start_index + chunk_offset + j
+                        if i > 0 and i % 500 == 0:
+                            percent = ((i + 1) * 100) // total_tests
+                            print(f"Progress: {percent}% ({i}/{total_tests})", flush=True)
+
+                        base_cmd = build_base_cmd(key_info, mods, locks)
+                        kitty_out_fmt = format_raw_output(kitty_outs[j])
+
+                        # Reconstruct arg string for the file
+                        # Format: INPUT_ARGS | FLAGS | OUTPUT
+                        input_args_str = " ".join(base_cmd + kitty_key_args(key_info))
+
+                        golden_file.write(f"{input_args_str} | {flags} | {kitty_out_fmt}\n")
+
+            print(f"Done. Golden rules saved to '{golden_path}'.")
         except IOError as e:
             print(f"Error writing to file: {e}", file=sys.stderr)
+        finally:
+            kitty.close()
         return
 
-    print(f"Starting tests for target: {args.target}")
+    targets = [TargetRun(name, args.targets, args.shard, total_tests) for name in args.targets]
+    # --resume, --incremental and --collapse-flags have a single target
+    run = targets[0]
+    cross = CrossTargetMatrix(args.targets) if len(targets) > 1 else None
+    print(f"Starting tests for target{'s' if cross else ''}: {', '.join(args.targets)}")
     print(f"Combinations to check: {len(all_combinations)}")
+    for t in targets:
+        # Per target also in single target runs, which alternate between targets
+        t.history = FailureHistory(shard_path(target_path(FAILURE_HISTORY_FILE, t.name), args.shard))
+    schedule = None
+    if args.failures_first:
+        all_combinations, first = schedule_failures_first(all_combinations, [t.history for t in targets])
+        schedule = all_combinations
+        print(f"Failures first: {first} combinations failed or changed status in recent runs.")
 
-    results = []
-    mismatch_count = 0
-    save_counter = 0
+    coverage = None
+    if args.coverage:
+        sides = [("kitty", KITTY_BRANCHES)]
+        for t in targets:
+            if 'branches' in t.conf:
+                sides.append((t.name, t.conf['branches']))
+                t.coverage_args = ['--coverage']
+        try:
+            coverage = CoverageReport(sides)
+        except OSError as e:
+            print(f"Error: Cannot read branch table: {e}. Build with 'make COVERAGE=1' first.", file=sys.stderr)
+            sys.exit(1)
+    kitty_coverage_args = ['--coverage'] if coverage else []
 
-    key_status = defaultdict(lambda: True)
+    log_path = run.path(RESULTS_LOG_FILE)
+    info = run_info(run.name, run.conf, all_combinations, run.history.run)
+    reuse_kitty = False
 
-    try:
-        for i_offset, (key_info, mods, locks, flags) in enumerate(all_combinations):
+    if args.resume:
+        header = read_log_header(log_path)
+        if header is None:
+            print(f"Error: Nothing to resume, '{log_path}' is missing or has no header.", file=sys.stderr)
+            sys.exit(1)
+        if {k: header.get(k) for k in ('target', 'combinations', 'matrix')} != {k: info[k] for k in ('target', 'combinations', 'matrix')}:
+            print(f"Error: '{log_path}' belongs to a run with a different target or combinations.", file=sys.stderr)
+            sys.exit(1)
+        if {k: v for k, v in header.items() if k != 'history_run'} != {k: v for k, v in info.items() if k != 'history_run'}:
+            print("Error: Encoder sources changed since the interrupted run. Use --incremental instead.", file=sys.stderr)
+            sys.exit(1)
+        # The history was not written by the interrupted run: replay its finished
+        # outcomes into the same run number, then carry on with the first missing one
+        run.history.run = header.get('history_run', run.history.run)
+        done = 0
+        for combination, r in zip(all_combinations, read_results_log(log_path)):
+            run.outcomes.add(start_index + done, r['combo'], r['status'], r['kitty_out_fmt'], r['target_out_fmt'])
+            if r['status'] != 'skipped_key_failing':
+                run.history.add(combination, r['combo'], r['status'])
+            run.key_mismatches[bisect.bisect_right(key_starts, start_index + done) - 1] += r['status'] == 'mismatch'
+            done += 1
+        all_combinations = all_combinations[done:]
+        start_index += done
+        print(f"Resuming after {done} finished combinations.")
+        run.results_log = ResultsLog.reopen(log_path)
+    else:
+        header = read_log_header(log_path) if args.incremental else None
+        if header and all(header.get(k) == info[k] for k in ('target', 'combinations', 'matrix')):
+            reuse_kitty = header['kitty_sources'] == info['kitty_sources']
+            run.reuse = header['target_sources'] == info['target_sources']
+        if reuse_kitty or run.reuse:
+            previous_path = log_path + PREVIOUS_LOG_SUFFIX
+            os.replace(log_path, previous_path)
+            run.previous = read_results_log(previous_path)
+            unchanged = " and ".join(side for side, reused in (("kitty", reuse_kitty), (run.name, run.reuse)) if reused)
+            print(f"Incremental: reusing {unchanged} outputs of the previous run.")
+        elif args.incremental:
+            print("Incremental: no reusable previous run, running all combinations.")
+        for t in targets:
+            # The combinations are the same for every target, hash them once
+            t_info = info if t is run else dict(info, target=t.name, target_sources=hash_inputs(t.conf['inputs']), history_run=t.history.run)
+            t.results_log = ResultsLog(t.path(RESULTS_LOG_FILE), t_info)
 
-            i = start_index + i_offset
-            key_name = key_info['name']
+    kitty = make_kitty_tester(args)
+    for t in targets:
+        t.tester = make_tester(t.conf['binary'], args, t.conf.get('tester_args', []))
+    trace_log = TraceLog(args.trace) if args.trace else None
+    profile = RunProfile()
 
-            if i > 0 and i % 500 == 0:
-                percent = ((i + 1) * 100) // total_tests
-                print(f"Progress: {percent}% ({i}/{total_tests}) | Found {mismatch_count} mismatches", flush=True)
+    def trace_failures(chunk):
+        # Reruns the failed combinations of a chunk with --trace, on kitty
+        # and on the target they failed in; the passing majority never pays
+        # for tracing
+        for t in targets:
+            for offset in range(0, len(t.failures), STREAM_BATCH):
+                batch = t.failures[offset:offset + STREAM_BATCH]
+                combos = [chunk[j] for j, _, _ in batch]
+                kitty.submit([build_kitty_args(build_base_cmd(k, m, l), k, f) + ['--trace'] for k, m, l, f in combos])
+                t.tester.submit(t.args(combos, ['--trace']))
+                kitty.collect()
+                t.tester.collect()
+                for (_, combo, status), kitty_trace, target_trace in zip(batch, kitty.traces, t.tester.traces):
+                    trace_log.add(combo, status, [("kitty", kitty_trace), (t.name, target_trace)])
 
-            base_cmd = ['--key', key_info['name']] + mods + locks
+    def run_testers(chunk, kitty_positions, target_positions, kitty_fmts, kitty_covs):
+        # Runs each tester for those of its positions whose output is still missing
+        kitty_positions = [j for j in kitty_positions if kitty_fmts[j] is None]
+        positions = [[j for j in target_positions if t.fmts[j] is None] for t in targets]
+        for offset in range(0, max([len(kitty_positions)] + [len(p) for p in positions]), STREAM_BATCH):
+            kitty_todo = kitty_positions[offset:offset + STREAM_BATCH]
+            todos = [p[offset:offset + STREAM_BATCH] for p in positions]
 
-            # Build commands
-            kitty_cmd = [KITTY_TESTER] + base_cmd + ['--kitty-flags', str(flags)]
-            if 'base_key' in key_info:
-                kitty_cmd.extend(['--base-key', key_info['base_key']])
-            target_cmd = target_conf['cmd_builder'](target_conf['binary'], base_cmd, key_info, flags)
+            # All testers work on the same batch concurrently, so the time
+            # waiting for a target excludes what it did during earlier waits
+            if kitty_todo:
+                with profile.phase('kitty'):
+                    kitty.submit([build_kitty_args(build_base_cmd(k, m, l), k, f) + kitty_coverage_args
+                                  for k, m, l, f in (chunk[j] for j in kitty_todo)])
+            for t, todo in zip(targets, todos):
+                if todo:
+                    with profile.phase(t.name):
+                        t.tester.submit(t.args((chunk[j] for j in todo), t.coverage_args))
+            if kitty_todo:
+                with profile.phase('kitty'):
+                    raws = kitty.collect()
+                profile.add_latencies('kitty', kitty.latencies)
+                with profile.phase('decode'):
+                    for j, raw in zip(kitty_todo, raws):
+                        kitty_fmts[j] = format_raw_output(raw)
+                if kitty_coverage_args:
+                    for j, bitmap in zip(kitty_todo, kitty.coverage):
+                        kitty_covs[j] = bitmap
+            for t, todo in zip(targets, todos):
+                if not todo:
+                    continue
+                with profile.phase(t.name):
+                    raws = t.tester.collect()
+                profile.add_latencies(t.name, t.tester.latencies)
+                with profile.phase('decode'):
+                    for j, raw in zip(todo, raws):
+                        t.fmts[j] = format_raw_output(raw)
+                if t.coverage_args:
+                    for j, bitmap in zip(todo, t.tester.coverage):
+                        t.covs[j] = bitmap
 
-            # Execution
-            kitty_out_raw = run_command(kitty_cmd, args.debug)
-            target_out_raw = run_command(target_cmd, args.debug)
+    def mismatch_counts():
+        if cross:
+            return ", ".join(f"{t.name} {t.outcomes.counts['mismatch']}" for t in targets)
+        return run.outcomes.counts['mismatch']
 
-            kitty_out_str = format_raw_output(kitty_out_raw)
-            target_out_str = format_raw_output(target_out_raw)
+    collapser = FlagCollapser(kitty_flags_to_test) if args.collapse_flags else None
+    # Whole cells of all flags values per chunk when collapsing
+    chunks = (chunked(all_combinations, COLLAPSE_CELLS * len(kitty_flags_to_test), start_index) if collapser
+              else chunked(all_combinations, STREAM_BATCH))
 
-            status = 'error'
+    # Combinations replayed by --resume are not part of this run's rates
+    replayed = sum(run.outcomes.counts.values())
+    # Only runs that went through all of the matrix (or of their shard) advance the failure history
+    completed = False
+    try:
+        for chunk_offset, chunk in chunks:
+            # Outputs of an unchanged side are taken from the previous run,
+            # except failures, which may have been transient
+            stored = list(itertools.islice(run.previous, len(chunk))) if run.previous else []
+            stored += [None] * (len(chunk) - len(stored))
+            kitty_fmts = [r['kitty_out_fmt'] if r and reuse_kitty and reusable_output(r['kitty_out_fmt']) else None for r in stored]
+            kitty_covs = [None] * len(chunk)
+            # Combination index and key number of every position
+            indices = [start_index + (schedule.index_at(chunk_offset + j) if schedule is not None else chunk_offset + j) for j in range(len(chunk))]
+            keys = [bisect.bisect_right(key_starts, i) - 1 for i in indices]
+            for t in targets:
+                t.fmts = [r['target_out_fmt'] if r and t.reuse and reusable_output(r['target_out_fmt']) else None for r in stored]
+                t.covs = [None] * len(chunk)
+                t.failures = []
+            if args.stop_key_after:
+                # Keys that already failed enough are not run, on kitty only
+                # if no target still needs them
+                for t in targets:
+                    for j, key in enumerate(keys):
+                        if t.key_mismatches[key] >= args.stop_key_after:
+                            t.fmts[j] = NOT_RUN_OUTPUT
+                for j in range(len(chunk)):
+                    if all(t.fmts[j] == NOT_RUN_OUTPUT for t in targets):
+                        kitty_fmts[j] = NOT_RUN_OUTPUT
 
-            if "[ERROR:" in kitty_out_str or "[ERROR:" in target_out_str:
-                status = 'error'
-            elif kitty_out_str == "[EMPTY]":
-                status = 'skipped_kitty_empty'
-            elif target_conf['is_fallback'](target_out_str):
-                status = 'skipped_target_fallback'
-            elif kitty_out_str == target_out_str:
-                status = 'match'
+            def run_chunk(kitty_positions, target_positions):
+                run_testers(chunk, kitty_positions, target_positions, kitty_fmts, kitty_covs)
+            if collapser:
+                with profile.phase('collapse'):
+                    collapser.evaluate(chunk, kitty_fmts, run.fmts, run_chunk)
             else:
-                status = 'mismatch'
-                mismatch_count += 1
+                run_chunk(range(len(chunk)), range(len(chunk)))
 
-            if status != 'match':
-                key_status[key_name] = False
+            with profile.phase('compare'):
+                for j, (key_info, mods, locks, flags) in enumerate(chunk):
+                    i = indices[j]
+                    position = start_index + chunk_offset + j
 
-            test_case = {
-                'combo': format_key_combo(key_info, mods, locks, flags),
-                'status': status,
-                'kitty_out': kitty_out_raw,
-                'target_out': target_out_raw,
-            }
-            results.append(test_case)
+                    if position > 0 and position % 500 == 0:
+                        percent = ((position + 1) * 100) // total_tests
+                        rate, average = profile.progress(sum(run.outcomes.counts.values()) - replayed)
+                        eta = f" | ETA {format_duration((total_tests - position) / rate)}" if rate else ""
+                        print(f"Progress: {percent}% ({position}/{total_tests}) | Found {mismatch_counts()} mismatches"
+                              f" | {rate:.0f}/s (avg {average:.0f}/s){eta}", flush=True)
 
-            if i > 0 and i % (SAVE_INTERVAL * 20) == 0:
-                save_counter += 1
-                print(f" [Save #{save_counter}] Saving intermediate results...")
-                save_results(results, args.target)
+                    combo = format_key_combo(key_info, mods, locks, flags)
+                    kitty_out_str = kitty_fmts[j]
+                    statuses = []
+                    for t in targets:
+                        reference_str, target_out_str = kitty_out_str, t.fmts[j]
+                        if args.stop_key_after and t.key_mismatches[keys[j]] >= args.stop_key_after:
+                            # Also those of the chunk that ran after the key reached
+                            # N, so that the outcome does not depend on the batching
+                            status = 'skipped_key_failing'
+                            reference_str = target_out_str = NOT_RUN_OUTPUT
+                        else:
+                            status = classify(kitty_out_str, target_out_str, t.conf['is_fallback'])
+                            t.history.add(chunk[j], combo, status)
+                            t.key_mismatches[keys[j]] += status == 'mismatch'
+                        with profile.phase('log'):
+                            t.results_log.append(i, combo, status, reference_str, target_out_str)
+                        t.outcomes.add(i, combo, status, reference_str, target_out_str)
+                        statuses.append(status)
+                        if trace_log and status in ('mismatch', 'error'):
+                            t.failures.append((j, combo, status))
+                    if cross:
+                        cross.add(combo, statuses)
+                    if coverage:
+                        coverage.add(combo, [kitty_covs[j]] + [t.covs[j] for t in targets if t.coverage_args])
+
+            with profile.phase('log'):
+                for t in targets:
+                    t.results_log.flush()
+            if any(t.failures for t in targets):
+                with profile.phase('trace'):
+                    trace_failures(chunk)
+        completed = not (args.limit or args.plan or args.start_at_percent)
 
     except KeyboardInterrupt:
         print("\nTest interrupted by user. Saving current results.")
     finally:
+        kitty.close()
+        for t in targets:
+            t.tester.close()
+            t.results_log.close()
+        if run.previous is not None:
+            os.remove(log_path + PREVIOUS_LOG_SUFFIX)
         sys.stdout.write("\n")
         print("Saving final results...")
-        save_results(results, args.target)
+        cross_path = shard_path(CROSS_TARGET_FILE, args.shard)
+        with profile.phase('save'):
+            for t in targets:
+                save_results(t.name, t.outcomes, t.path)
+                if completed:
+                    t.history.write()
+            if cross:
+                cross.write(cross_path)
+            if coverage:
+                coverage.write(args.coverage)
+            if trace_log:
+                trace_log.close()
+        profile_path = shard_path(PROFILE_FILE, args.shard)
+        run_profile = profile.summary([("kitty", kitty)] + [(t.name, t.tester) for t in targets],
+                                      sum(run.outcomes.counts.values()) - replayed)
+        with open(profile_path, 'w', encoding='utf-8') as f:
+            json.dump(run_profile, f, indent=2)
 
-        matches = len([r for r in results if r['status'] == 'match'])
-        mismatches = len([r for r in results if r['status'] == 'mismatch'])
-        errors = len([r for r in results if r['status'] == 'error'])
+        print("\n--- Test Summary ---")
+        for t in targets:
+            status_counts = t.outcomes.counts
+            matches = status_counts['match']
+            mismatches = status_counts['mismatch']
+            errors = status_counts['error']
 
-        skipped_kitty = len([r for r in results if r['status'] == 'skipped_kitty_empty'])
-        skipped_target = len([r for r in results if r['status'] == 'skipped_target_fallback'])
-        skipped_total = skipped_kitty + skipped_target
+            skipped_kitty = status_counts['skipped_kitty_empty']
+            skipped_target = status_counts['skipped_target_fallback']
+            skipped_total = skipped_kitty + skipped_target
 
-        total_keys_tested = len(key_status)
-        successful_keys_count = sum(1 for passed in key_status.values() if passed)
+            total_keys_tested, successful_keys_count = t.outcomes.block_results(key_starts)
 
-        print("\n--- Test Summary ---")
-        print(f"Target: {args.target}")
-        print(f"Total combinations run: {len(results)} / {total_tests}")
-        print(f"  Matches: {matches}")
-        print(f"  Mismatches: {mismatches}")
-        print(f"  Skipped: {skipped_total}")
-        print(f"    Kitty return nothing: {skipped_kitty}");
-        print(f"    Target falled back to legacy generation: {skipped_target}");
-        print(f"  Errors: {errors}")
+            if t is not run:
+                print()
+            print(f"Target: {t.name}")
+            print(f"Total combinations run: {sum(status_counts.values())} / {total_tests}")
+            print(f"  Matches: {matches}")
+            print(f"  Mismatches: {mismatches}")
+            print(f"  Skipped: {skipped_total}")
+            print(f"    Kitty return nothing: {skipped_kitty}");
+            print(f"    Target falled back to legacy generation: {skipped_target}");
+            print(f"  Errors: {errors}")
+            if args.stop_key_after:
+                print(f"  Not run (key already failing): {status_counts['skipped_key_failing']}")
+            print(f"Keys passing all their combinations: {successful_keys_count} / {total_keys_tested}")
+        print(f"\nTime: {format_duration(run_profile['seconds'])}, {run_profile['combinations_per_sec']:.0f} combinations/s | "
+              + ", ".join(f"{name} {seconds:.1f}s" for name, seconds in run_profile['phases'].items()))
         print("\n--- Output Files ---")
-        if mismatches or errors:
-            print(f"Mismatch details: '{MISMATCH_LOG_FILE}'")
-        print(f"Raw results: '{RESULTS_FILE}'")
+        for t in targets:
+            if t.outcomes.counts['mismatch'] or t.outcomes.counts['error']:
+                print(f"Mismatch details: '{t.path(MISMATCH_LOG_FILE)}'")
+            if t.outcomes.counts['mismatch']:
+                print(f"Mismatch clusters: '{t.path(MISMATCH_CLUSTERS_FILE)}'")
+            print(f"Raw results: '{t.path(RESULTS_FILE)}'")
+        if cross:
+            print(f"Cross-target matrix: '{cross_path}'")
+        print(f"Time profile: '{profile_path}'")
+        if coverage:
+            print(f"Branch coverage: '{args.coverage}'")
+        if trace_log:
+            print(f"Traces of {trace_log.combinations} mismatches and errors: '{args.trace}'")
+            if trace_log.combinations and not trace_log.traced:
+                print("  No encoder left trace records. Build with 'make TRACE=1' first.")
+        if collapser and collapser.total:
+            print(f"\nFlag collapse over {collapser.total} combinations: ran {collapser.runs[0]} on kitty, "
+                  f"{collapser.runs[1]} on {run.name}; {collapser.fallback_cells} cells needed all flags values")
 
 if __name__ == "__main__":
     main()
\ No newline at end of file
@@ -2,7 +2,10 @@
 import sys
 import os
 
-def extract_function_body(source_path, dest_path, signature, stop_marker):
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'common'))
+from coverage_instrument import instrument, write_branch_table
+
+def extract_function_body(source_path, dest_path, signature, stop_marker, coverage=False):
     if not os.path.exists(source_path):
         print(f"Error: Source file '{source_path}' not found.", file=sys.stderr)
         sys.exit(1)
@@ -25,17 +28,16 @@ def extract_function_body(source_path, dest_path, signature, stop_marker):
         print(f"Error: Function start for '{signature}' not found.", file=sys.stderr)
         sys.exit(1)
 
-    body.append('fprintf(stderr, "[DEBUG] Entering extracted code block.\\n");\n')
+    body.append('KT_TRACE("extracted body: entered");\n')
 
     brace_level = 1
     for line in iter_lines:
         if stop_marker in line:
-            body.append('fprintf(stderr, "[DEBUG] Hit legacy_fallback, breaking.\\n");\n')
+            body.append('KT_TRACE("extracted body: hit legacy_fallback");\n')
             break
 
         if "auto skipped_param2 = false;" in line:
-            body.append('fprintf(stderr, "[DEBUG] Modifiers value before formatting: %u\\n", modifiers);\n')
-            body.append('fprintf(stderr, "[DEBUG] Event type value before formatting: %d\\n", event_type);\n')
+            body.append('KT_TRACE("extracted body: modifiers=%u event_type=%u", modifiers, event_type);\n')
 
         processed_line = line.replace('goto legacy_fallback;', 'return false;')
         body.append(processed_line)
@@ -49,15 +51,21 @@ def extract_function_body(source_path, dest_path, signature, stop_marker):
         print(f"Error: Function body for '{signature}' is empty.", file=sys.stderr)
         sys.exit(1)
 
+    if coverage:
+        body = instrument(body)
+
     with open(dest_path, 'w', encoding='utf-8') as f:
         f.writelines(body)
 
     print(f"[*] Extracted function body to '{dest_path}'")
+    if coverage:
+        print(f"[*] Instrumented {write_branch_table(dest_path)} branches")
 
 if __name__ == "__main__":
     extract_function_body(
         source_path='source/vte.cc',
         dest_path='vte_test/vte_key_press_body.inc',
         signature='Terminal::widget_key_press',
-        stop_marker='legacy_fallback:'
+        stop_marker='legacy_fallback:',
+        coverage='--coverage' in sys.argv
     )
\ No newline at end of file
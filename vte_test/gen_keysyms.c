@@ -0,0 +1,191 @@
+/*
+ * Generates the GDK keysym data of vte_key_tester.h from xkbcommon.
+ *
+ *   gen_keysyms enum <xkbcommon-keysyms.h> <out>
+ *       GDK_KEY_<name> enumerators of every XKB_KEY_<name> the header defines
+ *   gen_keysyms tables <out>
+ *       Two-level lookup tables of gdk_keyval_to_unicode(),
+ *       gdk_keyval_to_lower() and gdk_keyval_to_upper()
+ *
+ * Both tables of a lookup split the key into a block number and an offset.
+ * The index maps the block number to one of the 64-entry blocks of a pool
+ * that all tables share; identical blocks, most of them all zero, are stored
+ * once. A value of 0 means no character, or a keysym without another case.
+ */
+
+#include <xkbcommon/xkbcommon.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_BITS 6
+#define BLOCK_SIZE (1u << BLOCK_BITS)
+
+// Legacy keysyms; Unicode keysyms are 0x01000000 + codepoint
+#define LEGACY_KEYSYMS 0x10000u
+#define UNICODE_KEYSYM 0x01000000u
+#define MAX_CODEPOINT 0x10ffffu
+
+static uint32_t (*pool)[BLOCK_SIZE];
+static size_t pool_blocks, pool_capacity;
+
+// The pool index of `block`, added if it is new
+static uint16_t intern_block(const uint32_t* block) {
+    for (size_t i = 0; i < pool_blocks; i++) {
+        if (memcmp(pool[i], block, sizeof(pool[i])) == 0) return (uint16_t)i;
+    }
+    if (pool_blocks == pool_capacity) {
+        pool_capacity = pool_capacity ? pool_capacity * 2 : 64;
+        pool = realloc(pool, pool_capacity * sizeof(pool[0]));
+        if (!pool) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(pool[pool_blocks], block, sizeof(pool[0]));
+    return (uint16_t)pool_blocks++;
+}
+
+struct table {
+    const char* name;
+    uint16_t* index;
+    size_t blocks;
+};
+
+// Splits `values` into blocks and interns them
+static void build_table(struct table* table, const char* name, const uint32_t* values, size_t count) {
+    table->name = name;
+    table->blocks = count / BLOCK_SIZE;
+    table->index = malloc(table->blocks * sizeof(uint16_t));
+    if (!table->index) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < table->blocks; i++) table->index[i] = intern_block(values + i * BLOCK_SIZE);
+}
+
+// GDK's case conversion of a keysym, or 0 if it has no other case. Unicode
+// keysyms convert like the keysym GDK would report for the character, and
+// the result is that of gdk_unicode_to_keyval(): legacy where one exists.
+static uint32_t convert_case(uint32_t keysym, xkb_keysym_t (*convert)(xkb_keysym_t)) {
+    if (keysym >= UNICODE_KEYSYM) {
+        keysym = xkb_utf32_to_keysym(keysym - UNICODE_KEYSYM);
+        if (!keysym) return 0;
+    }
+    uint32_t converted = convert(keysym);
+    if (converted == keysym) return 0;
+    if (converted >= UNICODE_KEYSYM) {
+        uint32_t legacy = xkb_utf32_to_keysym(converted - UNICODE_KEYSYM);
+        if (legacy) converted = legacy;
+    }
+    return converted;
+}
+
+static void write_index(FILE* out, const struct table* table) {
+    fprintf(out, "\ninline constexpr unsigned short %s_index[%zu] = {", table->name, table->blocks);
+    for (size_t i = 0; i < table->blocks; i++) {
+        fprintf(out, "%s%u,", i % 16 ? " " : "\n    ", table->index[i]);
+    }
+    fprintf(out, "\n};\n");
+}
+
+static int write_tables(const char* path) {
+    uint32_t* values = calloc(MAX_CODEPOINT + 1, sizeof(uint32_t));
+    if (!values) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    struct table tables[5];
+    for (uint32_t ks = 0; ks < LEGACY_KEYSYMS; ks++) values[ks] = xkb_keysym_to_utf32(ks);
+    build_table(&tables[0], "keysym_unicode", values, LEGACY_KEYSYMS);
+    for (uint32_t ks = 0; ks < LEGACY_KEYSYMS; ks++) values[ks] = convert_case(ks, xkb_keysym_to_lower);
+    build_table(&tables[1], "keysym_lower", values, LEGACY_KEYSYMS);
+    for (uint32_t ks = 0; ks < LEGACY_KEYSYMS; ks++) values[ks] = convert_case(ks, xkb_keysym_to_upper);
+    build_table(&tables[2], "keysym_upper", values, LEGACY_KEYSYMS);
+
+    // Codepoint tables end after the last block with a case pair, so that
+    // the CJK and astral planes cost nothing
+    size_t limit = 0;
+    uint32_t* upper = calloc(MAX_CODEPOINT + 1, sizeof(uint32_t));
+    if (!upper) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    for (uint32_t cp = 0; cp <= MAX_CODEPOINT; cp++) {
+        values[cp] = convert_case(UNICODE_KEYSYM + cp, xkb_keysym_to_lower);
+        upper[cp] = convert_case(UNICODE_KEYSYM + cp, xkb_keysym_to_upper);
+        if (values[cp] || upper[cp]) limit = (cp / BLOCK_SIZE + 1) * BLOCK_SIZE;
+    }
+    build_table(&tables[3], "codepoint_lower", values, limit);
+    build_table(&tables[4], "codepoint_upper", upper, limit);
+    free(upper);
+    free(values);
+
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return 1;
+    }
+    size_t bytes = pool_blocks * sizeof(pool[0]);
+    for (size_t i = 0; i < 5; i++) bytes += tables[i].blocks * sizeof(uint16_t);
+    fprintf(out, "// Generated by vte_test/gen_keysyms from xkbcommon, do not edit\n");
+    fprintf(out, "// %zu blocks of %u keysyms or codepoints, %zu bytes in all\n\n", pool_blocks, BLOCK_SIZE, bytes);
+    fprintf(out, "enum { KEYSYM_BLOCK_BITS = %u, KEYSYM_LEGACY_END = 0x%x, KEYSYM_CASE_CODEPOINT_END = 0x%zx };\n\n",
+            BLOCK_BITS, LEGACY_KEYSYMS, limit);
+    fprintf(out, "inline constexpr unsigned keysym_blocks[%zu][%u] = {\n", pool_blocks, BLOCK_SIZE);
+    for (size_t i = 0; i < pool_blocks; i++) {
+        fprintf(out, "    {");
+        for (size_t j = 0; j < BLOCK_SIZE; j++) {
+            fprintf(out, "%s0x%x,", j == 0 ? "" : j % 8 ? " " : "\n     ", pool[i][j]);
+        }
+        fprintf(out, "},\n");
+    }
+    fprintf(out, "};\n");
+    for (size_t i = 0; i < 5; i++) {
+        write_index(out, &tables[i]);
+        free(tables[i].index);
+    }
+    fclose(out);
+    free(pool);
+    return 0;
+}
+
+static int write_enum(const char* header, const char* path) {
+    FILE* in = fopen(header, "r");
+    if (!in) {
+        fprintf(stderr, "Error: cannot read %s\n", header);
+        return 1;
+    }
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        fclose(in);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by vte_test/gen_keysyms from xkbcommon-keysyms.h, do not edit\n");
+    char line[512], name[256];
+    unsigned value;
+    size_t count = 0;
+    while (fgets(line, sizeof(line), in)) {
+        if (sscanf(line, "#define XKB_KEY_%255s 0x%x", name, &value) != 2) continue;
+        fprintf(out, "    GDK_KEY_%s = 0x%x,\n", name, value);
+        count++;
+    }
+    fclose(in);
+    fclose(out);
+    if (!count) {
+        fprintf(stderr, "Error: no XKB_KEY_ definitions in %s\n", header);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "enum") == 0) return write_enum(argv[2], argv[3]);
+    if (argc == 3 && strcmp(argv[1], "tables") == 0) return write_tables(argv[2]);
+    fprintf(stderr, "Usage: %s enum <xkbcommon-keysyms.h> <out> | tables <out>\n", argv[0]);
+    return 2;
+}
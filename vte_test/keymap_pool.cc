@@ -0,0 +1,162 @@
+#include "keymap_pool.h"
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Set by the Makefile from pkg-config
+#ifndef KT_XKBCOMMON_VERSION
+#define KT_XKBCOMMON_VERSION "unknown"
+#endif
+
+KeymapPool& KeymapPool::instance() {
+    static KeymapPool pool;
+    return pool;
+}
+
+KeymapPool::KeymapPool() {
+    m_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!m_context) {
+        fprintf(stderr, "[ERROR] xkb_context_new failed.\n");
+    }
+}
+
+KeymapPool::~KeymapPool() {
+    for (auto& entry : m_keymaps) {
+        if (entry.second) xkb_keymap_unref(entry.second);
+    }
+    if (m_context) xkb_context_unref(m_context);
+}
+
+void KeymapPool::set_cache_dir(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cache_dir = dir;
+}
+
+// An XKB_DEFAULT_* variable, which xkbcommon uses for the names get() leaves unset
+static std::string default_name(const char* variable, const char* fallback) {
+    const char* value = getenv(variable);
+    return value && *value ? value : fallback;
+}
+
+std::string KeymapPool::cache_key(const std::string& layout) const {
+    // The names xkb_keymap_new_from_names() resolves, with xkbcommon's own
+    // defaults (evdev rules, pc105 model); variants are part of the layout
+    // name, like "de(nodeadkeys)"
+    std::string rules = default_name("XKB_DEFAULT_RULES", "evdev");
+    std::string key = "xkbcommon " KT_XKBCOMMON_VERSION "\nrules " + rules +
+        "\nmodel " + default_name("XKB_DEFAULT_MODEL", "pc105") + "\nlayout " + layout +
+        "\noptions " + default_name("XKB_DEFAULT_OPTIONS", "") + "\n";
+
+    // The rules file and the layout's symbols file of the xkb data, which
+    // an xkeyboard-config upgrade replaces without changing the names
+    std::string symbols = layout.substr(0, layout.find('('));
+    for (const std::string& file : {"rules/" + rules, "symbols/" + symbols}) {
+        for (unsigned i = 0; m_context && i < xkb_context_num_include_paths(m_context); i++) {
+            struct stat st;
+            std::string path = std::string(xkb_context_include_path_get(m_context, i)) + "/" + file;
+            if (stat(path.c_str(), &st) == 0) {
+                key += path + " " + std::to_string(st.st_size) + " " + std::to_string(st.st_mtime) + "\n";
+                break;
+            }
+        }
+    }
+    return key;
+}
+
+std::string KeymapPool::cache_path(const std::string& layout) const {
+    // Layout names may carry variants like "de(nodeadkeys)"
+    std::string name;
+    for (char c : layout) {
+        name += isalnum((unsigned char)c) ? c : '_';
+    }
+    // FNV-1a of the key: a keymap compiled from other names, data or
+    // xkbcommon gets another file
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : cache_key(layout)) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+    char suffix[20];
+    snprintf(suffix, sizeof(suffix), "-%016llx", (unsigned long long)hash);
+    return m_cache_dir + "/" + name + suffix + ".xkb";
+}
+
+struct xkb_keymap* KeymapPool::load_cached(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return nullptr;
+
+    std::ostringstream text;
+    text << in.rdbuf();
+    // An unreadable cached keymap is recompiled and overwritten by get()
+    return xkb_keymap_new_from_string(m_context, text.str().c_str(),
+        XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+}
+
+void KeymapPool::store_cached(const std::string& path, struct xkb_keymap* keymap) {
+    char* text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    if (!text) return;
+
+    // Write to a temporary file first, so that concurrent testers never
+    // observe a half-written keymap
+    std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(tmp_path, std::ios::binary);
+        out << text;
+    }
+    free(text);
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+    }
+}
+
+struct xkb_keymap* KeymapPool::get(const std::string& layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_keymaps.find(layout);
+    if (it != m_keymaps.end()) return it->second;
+
+    struct xkb_keymap* keymap = nullptr;
+    if (m_context) {
+        std::string path = m_cache_dir.empty() ? "" : cache_path(layout);
+        if (!path.empty()) {
+            keymap = load_cached(path);
+        }
+        if (!keymap) {
+            struct xkb_rule_names rules = {};
+            rules.layout = layout.c_str();
+            keymap = xkb_keymap_new_from_names(m_context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+            if (!keymap) {
+                fprintf(stderr, "[ERROR] xkb_keymap_new_from_names failed for layout '%s'.\n", layout.c_str());
+            } else if (!path.empty()) {
+                store_cached(path, keymap);
+            }
+        }
+    }
+
+    // Failures are remembered too, so a broken layout is not recompiled per event
+    m_keymaps[layout] = keymap;
+    return keymap;
+}
+
+struct xkb_state* KeymapPool::new_state(struct xkb_keymap* keymap) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return xkb_state_new(keymap);
+}
+
+void KeymapPool::unref_state(struct xkb_state* state) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    xkb_state_unref(state);
+}
+
+xkb_keysym_t KeymapPool::keysym(const std::string& layout, xkb_keycode_t keycode, xkb_level_index_t level) {
+    struct xkb_keymap* keymap = get(layout);
+    if (!keymap) return 0;
+
+    const xkb_keysym_t* syms = nullptr;
+    int count = xkb_keymap_key_get_syms_by_level(keymap, keycode, 0, level, &syms);
+    return count > 0 ? syms[0] : 0;
+}
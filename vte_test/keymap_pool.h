@@ -0,0 +1,58 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <xkbcommon/xkbcommon.h>
+
+// Process-wide cache of compiled xkb keymaps.
+//
+// Compiling a keymap with xkb_keymap_new_from_names() is by far the most
+// expensive thing the VTE tester does, so every layout is compiled only once
+// per process. If a cache directory is set, compiled keymaps are also
+// serialised there with xkb_keymap_get_as_string() and later processes
+// reload them with xkb_keymap_new_from_string() instead of recompiling. The
+// file name includes a hash of the xkbcommon version, the rule names and
+// the xkb data files used, so upgrades do not serve stale keymaps.
+//
+// The pool is thread-safe. Keymaps are immutable once compiled and may be
+// read from any thread.
+class KeymapPool {
+public:
+    static KeymapPool& instance();
+
+    void set_cache_dir(const std::string& dir);
+
+    // Returns the keymap for `layout`, or nullptr if it cannot be compiled.
+    // The pool keeps ownership: keymaps stay valid until the process exits.
+    struct xkb_keymap* get(const std::string& layout);
+
+    // Keysym produced by `keycode` at shift level `level` of `layout`,
+    // or 0 (XKB_KEY_NoSymbol) if there is none.
+    xkb_keysym_t keysym(const std::string& layout, xkb_keycode_t keycode, xkb_level_index_t level);
+
+    // xkb_state_new() and xkb_state_unref() adjust the keymap's reference
+    // count without synchronisation, so terminals on different threads
+    // create and release their states through the pool.
+    struct xkb_state* new_state(struct xkb_keymap* keymap);
+    void unref_state(struct xkb_state* state);
+
+    struct xkb_context* context() const { return m_context; }
+
+private:
+    KeymapPool();
+    ~KeymapPool();
+    KeymapPool(const KeymapPool&) = delete;
+    KeymapPool& operator=(const KeymapPool&) = delete;
+
+    // Everything a compiled keymap of `layout` depends on, hashed into its file name
+    std::string cache_key(const std::string& layout) const;
+    std::string cache_path(const std::string& layout) const;
+    struct xkb_keymap* load_cached(const std::string& path);
+    void store_cached(const std::string& path, struct xkb_keymap* keymap);
+
+    std::mutex m_mutex;
+    struct xkb_context* m_context = nullptr;
+    std::map<std::string, struct xkb_keymap*> m_keymaps;
+    std::string m_cache_dir;
+};
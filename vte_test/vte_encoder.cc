@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "vte_key_tester.h"
+#include "keymap_pool.h"
+#include "../common/kt_plugin.h"
+#include "../common/kt_keydb.h"
+
+struct KeyvalEntry {
+    const char* name;
+    guint keyval;
+};
+
+// Generated from common/key_db.py
+#include "vte_keys.inc"
+
+// The keyval of a US layout key name, or 0
+static constexpr guint find_keyval(const char* name) {
+    const KeyvalEntry& entry = key_table[kt_key_slot(name, key_table_seeds, KEY_TABLE_BUCKETS, KEY_TABLE_SLOTS)];
+    if (!entry.name) return 0;
+    for (size_t i = 0; ; ++i) {
+        if (entry.name[i] != name[i]) return 0;
+        if (!name[i]) return entry.keyval;
+    }
+}
+
+static_assert(find_keyval("a") == 'a' && find_keyval("KP_End") == GDK_KEY_KP_End && find_keyval("nope") == 0,
+              "key table lookup");
+
+extern "C" KT_EXPORT int kt_abi_version(void) {
+    return KT_PLUGIN_ABI_VERSION;
+}
+
+extern "C" KT_EXPORT const char* kt_name(void) {
+    return "vte";
+}
+
+static int encode_error(const std::string& msg, char* out, size_t out_size) {
+    snprintf(out, out_size, "%s", msg.c_str());
+    return KT_ENCODE_ERROR;
+}
+
+// Runs one event through TesterTerminal::widget_key_press(). The output is
+// what VTE would send to the child, or "[LEGACY_FALLBACK]".
+extern "C" KT_EXPORT int kt_encode(const kt_key_event* kev, char* out, size_t out_size) {
+    // Every thread drives its own terminal, reset before each event
+    thread_local TesterTerminal terminal;
+
+    std::string key_name = kev->key ? kev->key : "";
+    std::string layout = kev->layout ? kev->layout : "";
+    guint keycode = kev->keycode;
+
+    GdkModifierType modifiers = (GdkModifierType)0;
+    if (kev->mods & KT_MOD_SHIFT) modifiers = (GdkModifierType)(modifiers | GDK_SHIFT_MASK);
+    if (kev->mods & KT_MOD_CTRL) modifiers = (GdkModifierType)(modifiers | GDK_CONTROL_MASK);
+    if (kev->mods & KT_MOD_ALT) modifiers = (GdkModifierType)(modifiers | VTE_ALT_MASK);
+    if (kev->mods & KT_MOD_SUPER) modifiers = (GdkModifierType)(modifiers | GDK_SUPER_MASK);
+    if (kev->mods & KT_MOD_CAPS) modifiers = (GdkModifierType)(modifiers | GDK_LOCK_MASK);
+    if (kev->mods & KT_MOD_NUM) modifiers = (GdkModifierType)(modifiers | VTE_NUMLOCK_MASK);
+    bool is_press = kev->action != KT_ACTION_RELEASE;
+
+    if ((key_name.empty() && layout.empty()) || keycode == 0) {
+        return encode_error("Error: --key and --keycode are required.", out, out_size);
+    }
+
+    guint keyval = 0;
+    if (!layout.empty() && layout != "us") {
+        // Like the hardcoded 'я' entry, the event carries the unshifted
+        // keysym the physical key produces in the active layout
+        keyval = KeymapPool::instance().keysym(layout, keycode, 0);
+        if (!keyval) {
+            return encode_error("Error: Keycode " + std::to_string(keycode) + " produces no symbol in layout '" + layout + "'", out, out_size);
+        }
+    } else if (uint32_t cp = kt_key_codepoint(key_name.c_str())) {
+        // A key of the Unicode sweep: the keysym GDK reports for a key
+        // typing that character, legacy or Unicode (0x01000000 + codepoint)
+        keyval = xkb_utf32_to_keysym(cp);
+    } else {
+        keyval = find_keyval(key_name.c_str());
+        if (!keyval) {
+            return encode_error("Error: Unknown key name '" + key_name + "'", out, out_size);
+        }
+    }
+
+    terminal.reset();
+    terminal.set_kitty_keyboard_flags(kev->kitty_flags);
+
+    MockKeyEvent event(keyval, keycode, modifiers, is_press);
+
+    terminal.widget_key_press(event);
+
+    size_t len = std::min(terminal.m_output.size(), out_size);
+    memcpy(out, terminal.m_output.data(), len);
+    return (int)len;
+}
@@ -1,5 +1,8 @@
 #include "vte_key_tester.h"
 #include "kittykeys.h"
+#include "keymap_pool.h"
+#include "../common/kt_coverage.h" // KT_COV_HIT() of a COVERAGE=1 build
+#include "../common/kt_trace.h" // KT_TRACE() of a TRACE=1 build
 #include <iostream>
 #include <cstdio>
 
@@ -21,48 +24,55 @@ bool MockKeyEvent::is_key_press() const { return m_is_press; }
 
 // TesterTerminal implementation
 TesterTerminal::TesterTerminal() {
-    fprintf(stderr, "[DEBUG] Initializing TesterTerminal...\n");
-    m_xkb_data.context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    KT_TRACE("TesterTerminal: initializing");
+    KeymapPool& pool = KeymapPool::instance();
+    m_xkb_data.context = pool.context();
     if (!m_xkb_data.context) {
         fprintf(stderr, "[ERROR] xkb_context_new failed.\n");
         m_kitty_keyboard_mode_is_available = false;
         return;
     }
-    fprintf(stderr, "[DEBUG] xkb_context_new OK.\n");
+    KT_TRACE("TesterTerminal: xkb context OK");
 
-    struct xkb_rule_names rules = { .layout = "us" };
-    m_xkb_data.keymap_us = xkb_keymap_new_from_names(m_xkb_data.context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    // Compiled once per process by the pool, shared by all terminals
+    m_xkb_data.keymap_us = pool.get("us");
     if (!m_xkb_data.keymap_us) {
         fprintf(stderr, "[ERROR] xkb_keymap_new_from_names failed.\n");
         m_kitty_keyboard_mode_is_available = false;
         return;
     }
-    fprintf(stderr, "[DEBUG] xkb_keymap_new_from_names OK.\n");
+    KT_TRACE("TesterTerminal: xkb keymap OK");
 
-    m_xkb_data.state_us = xkb_state_new(m_xkb_data.keymap_us);
+    m_xkb_data.state_us = pool.new_state(m_xkb_data.keymap_us);
     if (!m_xkb_data.state_us) {
         fprintf(stderr, "[ERROR] xkb_state_new failed.\n");
         m_kitty_keyboard_mode_is_available = false;
         return;
     }
-    fprintf(stderr, "[DEBUG] xkb_state_new OK. kitty mode is available.\n");
+    KT_TRACE("TesterTerminal: xkb state OK, kitty mode is available");
 }
 
 TesterTerminal::~TesterTerminal() {
-    if (m_xkb_data.state_us) xkb_state_unref(m_xkb_data.state_us);
-    if (m_xkb_data.keymap_us) xkb_keymap_unref(m_xkb_data.keymap_us);
-    if (m_xkb_data.context) xkb_context_unref(m_xkb_data.context);
+    // The context and keymap belong to KeymapPool
+    if (m_xkb_data.state_us) KeymapPool::instance().unref_state(m_xkb_data.state_us);
 }
 
 void TesterTerminal::send_child(const std::string& seq_str) {
-    fprintf(stderr, "[DEBUG] SENDING TO STDOUT: ");
-    for(char c : seq_str) {
-        if(c == '\x1b') fprintf(stderr, "ESC");
-        else if(isprint(c)) fprintf(stderr, "%c", c);
-        else fprintf(stderr, "\\x%02x", (unsigned char)c);
+    KT_TRACE("send_child: %u bytes", seq_str.size());
+    m_output += seq_str;
+}
+
+// Drops everything a previous event left behind, so that a single terminal
+// can serve many events in --stream mode exactly like a fresh process would.
+void TesterTerminal::reset() {
+    m_output.clear();
+    m_active_keys.clear();
+    m_kitty_keyboard_flags = 0;
+    if (m_xkb_data.state_us) {
+        KeymapPool& pool = KeymapPool::instance();
+        pool.unref_state(m_xkb_data.state_us);
+        m_xkb_data.state_us = pool.new_state(m_xkb_data.keymap_us);
     }
-    fprintf(stderr, "\n");
-    std::cout.write(seq_str.c_str(), seq_str.length());
 }
 
 void TesterTerminal::set_kitty_keyboard_flags(int flags) {
@@ -70,16 +80,13 @@ void TesterTerminal::set_kitty_keyboard_flags(int flags) {
 }
 
 bool TesterTerminal::widget_key_press(const MockKeyEvent& event) {
-    fprintf(stderr, "\n--- widget_key_press ---\n");
-    fprintf(stderr, "PARAMS: Keyval=0x%x, Keycode=%u, KittyFlags=%d, Press=%d\n",
-        event.keyval(), event.keycode(), m_kitty_keyboard_flags, event.is_key_press());
-    fprintf(stderr, "PRE-CHECK: kitty_flags > 0? %s\n", (m_kitty_keyboard_flags > 0) ? "yes" : "no");
-    fprintf(stderr, "PRE-CHECK: kitty_mode_available? %s\n", m_kitty_keyboard_mode_is_available ? "yes" : "no");
-    fprintf(stderr, "PRE-CHECK: event.keycode() != 0? %s\n", (event.keycode() != 0) ? "yes" : "no");
+    KT_TRACE("widget_key_press: keyval=0x%x keycode=%u kitty_flags=%u press=%u mods=0x%x kitty_mode_available=%u",
+        event.keyval(), event.keycode(), m_kitty_keyboard_flags, event.is_key_press(),
+        event.modifiers(), m_kitty_keyboard_mode_is_available);
 
 #include "vte_key_press_body.inc"
 
-    fprintf(stderr, "[DEBUG] Reached legacy_fallback.\n");
-    std::cout << "[LEGACY_FALLBACK]";
+    KT_TRACE("widget_key_press: reached legacy_fallback");
+    m_output += "[LEGACY_FALLBACK]";
     return false;
 }
\ No newline at end of file
@@ -29,124 +29,42 @@ typedef unsigned int GdkModifierType;
 #define VTE_NUMLOCK_MASK	GDK_MOD2_MASK
 
 // --- GDK Key Symbols (from gdkkeysyms.h) ---
+// GDK names every keysym of xkbcommon-keysyms.h, with the GDK_KEY_ prefix
 enum {
-    GDK_KEY_a = 0x0061,
-    GDK_KEY_z = 0x007a,
-    GDK_KEY_0 = 0x0030,
-    GDK_KEY_9 = 0x0039,
-    GDK_KEY_minus = 0x002d,
-    GDK_KEY_equal = 0x003d,
-    GDK_KEY_space = 0x0020,
-    GDK_KEY_Escape = 0xff1b,
-    GDK_KEY_Tab = 0xff09,
-    GDK_KEY_Return = 0xff0d,
-    GDK_KEY_BackSpace = 0xff08,
-    GDK_KEY_Home = 0xff50,
-    GDK_KEY_End = 0xff57,
-    GDK_KEY_Up = 0xff52,
-    GDK_KEY_Down = 0xff54,
-    GDK_KEY_Left = 0xff51,
-    GDK_KEY_Right = 0xff53,
-    GDK_KEY_Insert = 0xff63,
-    GDK_KEY_Delete = 0xffff,
-    GDK_KEY_Page_Up = 0xff55,
-    GDK_KEY_Page_Down = 0xff56,
-    GDK_KEY_bracketleft = 0x005b,
-    GDK_KEY_bracketright = 0x005d,
-    GDK_KEY_backslash = 0x005c,
-    GDK_KEY_semicolon = 0x003b,
-    GDK_KEY_apostrophe = 0x0027,
-    GDK_KEY_comma = 0x002c,
-    GDK_KEY_period = 0x002e,
-    GDK_KEY_slash = 0x002f,
-    GDK_KEY_grave = 0x0060,
-
-    // Shifted symbols
-    GDK_KEY_asciitilde = 0x007e,
-    GDK_KEY_underscore = 0x005f,
-    GDK_KEY_plus = 0x002b,
-    GDK_KEY_braceleft = 0x007b,
-    GDK_KEY_braceright = 0x007d,
-    GDK_KEY_bar = 0x007c,
-    GDK_KEY_colon = 0x003a,
-    GDK_KEY_quotedbl = 0x0022,
-    GDK_KEY_less = 0x003c,
-    GDK_KEY_greater = 0x003e,
-    GDK_KEY_question = 0x003f,
-
-    // Function keys
-    GDK_KEY_F1 = 0xffbe, GDK_KEY_F2 = 0xffbf, GDK_KEY_F3 = 0xffc0,
-    GDK_KEY_F4 = 0xffc1, GDK_KEY_F5 = 0xffc2, GDK_KEY_F6 = 0xffc3,
-    GDK_KEY_F7 = 0xffc4, GDK_KEY_F8 = 0xffc5, GDK_KEY_F9 = 0xffc6,
-    GDK_KEY_F10 = 0xffc7, GDK_KEY_F11 = 0xffc8, GDK_KEY_F12 = 0xffc9,
-
-    // Misc function keys
-    GDK_KEY_Scroll_Lock = 0xFF14,
-    GDK_KEY_Num_Lock = 0xFF7F,
-    GDK_KEY_Caps_Lock = 0xFFE5,
-    GDK_KEY_Print = 0xFF61,
-    GDK_KEY_Pause = 0xFF13,
-    GDK_KEY_Menu = 0xFF67,
-
-    // Modifier keys
-    GDK_KEY_Shift_L = 0xFFE1,
-    GDK_KEY_Shift_R = 0xFFE2,
-    GDK_KEY_Control_L = 0xFFE3,
-    GDK_KEY_Control_R = 0xFFE4,
-    GDK_KEY_Alt_L = 0xFFE9,
-    GDK_KEY_Alt_R = 0xFFEA,
-    GDK_KEY_Meta_L = 0xFFE7, // Super_L
-    GDK_KEY_Meta_R = 0xFFE8, // Super_R
-    GDK_KEY_ISO_Level3_Shift = 0xFE03,
+#include "gdk_keysyms.inc"
+};
 
-    // Keypad keys
-    GDK_KEY_KP_0 = 0xffb0, GDK_KEY_KP_1 = 0xffb1, GDK_KEY_KP_2 = 0xffb2,
-    GDK_KEY_KP_3 = 0xffb3, GDK_KEY_KP_4 = 0xffb4, GDK_KEY_KP_5 = 0xffb5,
-    GDK_KEY_KP_6 = 0xffb6, GDK_KEY_KP_7 = 0xffb7, GDK_KEY_KP_8 = 0xffb8,
-    GDK_KEY_KP_9 = 0xffb9,
-    GDK_KEY_KP_Decimal = 0xffae,
-    GDK_KEY_KP_Divide = 0xffaf,
-    GDK_KEY_KP_Multiply = 0xffaa,
-    GDK_KEY_KP_Subtract = 0xffad,
-    GDK_KEY_KP_Add = 0xffab,
-    GDK_KEY_KP_Enter = 0xff8d,
-    GDK_KEY_KP_Equal = 0xffbd,
-    GDK_KEY_KP_Separator = 0xffac,
-    GDK_KEY_KP_Left = 0xff96,
-    GDK_KEY_KP_Right = 0xff98,
-    GDK_KEY_KP_Up = 0xff97,
-    GDK_KEY_KP_Down = 0xff99,
-    GDK_KEY_KP_Page_Up = 0xff9a,
-    GDK_KEY_KP_Page_Down = 0xff9b,
-    GDK_KEY_KP_Home = 0xff95,
-    GDK_KEY_KP_End = 0xff9c,
-    GDK_KEY_KP_Insert = 0xff9e,
-    GDK_KEY_KP_Delete = 0xff9f,
-    GDK_KEY_KP_Begin = 0xff9d,
+// gdk_keyval_to_unicode() and case conversion data of all keysyms, generated
+// by vte_test/gen_keysyms from xkbcommon
+#include "keysym_tables.inc"
 
-    // Cyrillic
-    GDK_KEY_Cyrillic_ya = 0x06d1,
-    GDK_KEY_Cyrillic_YA = 0x06f1
-};
+static inline guint keysym_table_lookup(const unsigned short* index, guint key) {
+    return keysym_blocks[index[key >> KEYSYM_BLOCK_BITS]][key & ((1u << KEYSYM_BLOCK_BITS) - 1)];
+}
 
 static inline guint gdk_keyval_to_unicode(guint keyval) {
-    if (keyval >= 0x0020 && keyval <= 0x007e) return keyval; // ASCII
-    if (keyval >= 0x00a0 && keyval <= 0x00ff) return keyval; // Latin-1
-    if (keyval == GDK_KEY_Cyrillic_ya) return 0x044F; // 1103 я
-    if (keyval == GDK_KEY_Cyrillic_YA) return 0x042F; // 1071 Я
-    // Simplified stub for tests
-    return keyval;
+    if ((keyval & 0xff000000) == 0x01000000) return keyval & 0x00ffffff; // Unicode keysyms
+    if (keyval < KEYSYM_LEGACY_END) return keysym_table_lookup(keysym_unicode_index, keyval);
+    return 0;
 }
+
+// The keysym of the other case, which is legacy wherever one exists, like
+// GDK's gdk_keyval_convert_case()
+static inline guint keysym_convert_case(guint keyval, const unsigned short* keysym_index,
+                                        const unsigned short* codepoint_index) {
+    guint converted = 0;
+    if (keyval < KEYSYM_LEGACY_END) converted = keysym_table_lookup(keysym_index, keyval);
+    else if (keyval >= 0x01000000 && keyval - 0x01000000 < KEYSYM_CASE_CODEPOINT_END)
+        converted = keysym_table_lookup(codepoint_index, keyval - 0x01000000);
+    return converted ? converted : keyval;
+}
+
 static inline guint gdk_keyval_to_lower(guint keyval) {
-    if (keyval >= 'A' && keyval <= 'Z') return keyval + ('a' - 'A');
-    if (keyval >= 0x06f1 && keyval <= 0x06fe) return keyval - 0x20;
-    return keyval;
+    return keysym_convert_case(keyval, keysym_lower_index, codepoint_lower_index);
 }
 
 static inline guint gdk_keyval_to_upper(guint keyval) {
-    if (keyval >= 'a' && keyval <= 'z') return keyval - ('a' - 'A');
-    if (keyval >= 0x06d1 && keyval <= 0x06de) return keyval + 0x20;
-    return keyval;
+    return keysym_convert_case(keyval, keysym_upper_index, codepoint_upper_index);
 }
 
 class MockKeyEvent {
@@ -174,9 +92,11 @@ public:
     int m_kitty_keyboard_flags = 0;
     std::unordered_set<guint> m_active_keys;
     bool m_kitty_keyboard_mode_is_available = true;
+    std::string m_output;
 
     TesterTerminal();
     ~TesterTerminal();
+    void reset();
     void send_child(const std::string& seq_str);
     void set_kitty_keyboard_flags(int flags);
     bool widget_key_press(const MockKeyEvent& event);